@@ -0,0 +1,167 @@
+#include "Arena.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#endif
+
+// huge pages are 2 MB on the machines we run on, a region that is a multiple of it can use them throughout
+const size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+Arena::Arena(size_t bytes)
+{
+	// an empty arena reserves nothing and leaves every allocation to the heap
+	if (bytes == 0)
+	{
+		return;
+	}
+	size_t size = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	void* region = nullptr;
+
+#ifdef _WIN32
+	// large pages need the "lock pages in memory" privilege, without it this fails and we use normal ones
+	size_t large = GetLargePageMinimum();
+	if (large && size % large == 0)
+	{
+		region = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE);
+		if (region)
+		{
+			backing = "huge pages";
+		}
+	}
+	if (!region)
+	{
+		region = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+	}
+#else
+#ifdef MAP_HUGETLB
+	// only succeeds if huge pages were reserved up front (vm.nr_hugepages)
+	region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (region != MAP_FAILED)
+	{
+		backing = "huge pages";
+	}
+	else
+#endif
+	{
+		region = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (region == MAP_FAILED)
+		{
+			region = nullptr;
+		}
+#ifdef MADV_HUGEPAGE
+		else if (madvise(region, size, MADV_HUGEPAGE) == 0)
+		{
+			backing = "transparent huge pages";
+		}
+#endif
+	}
+#endif
+
+	if (region)
+	{
+		base = static_cast<uint8_t*>(region);
+		capacity = size;
+	}
+}
+
+Arena::~Arena()
+{
+	if (!base)
+	{
+		return;
+	}
+#ifdef _WIN32
+	VirtualFree(base, 0, MEM_RELEASE);
+#else
+	munmap(base, capacity);
+#endif
+}
+
+void* Arena::Allocate(size_t size)
+{
+	size = Rounded(size);
+
+	if (size <= ARENA_RECYCLE_MAX)
+	{
+		std::lock_guard<std::mutex> lock(freeMutex);
+		FreeBlock*& head = freeLists[size / ARENA_BLOCK_SIZE];
+		if (head)
+		{
+			FreeBlock* block = head;
+			head = block->next;
+			return block;
+		}
+	}
+
+	size_t offset = used.fetch_add(size);
+	if (offset + size > capacity)
+	{
+		return nullptr;
+	}
+	return base + offset;
+}
+
+void Arena::Free(void* block, size_t size)
+{
+	size = Rounded(size);
+	if (size > ARENA_RECYCLE_MAX)
+	{
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(freeMutex);
+	FreeBlock*& head = freeLists[size / ARENA_BLOCK_SIZE];
+	head = new (block) FreeBlock{head};
+}
+
+void Arena::Reset()
+{
+	std::lock_guard<std::mutex> lock(freeMutex);
+	std::fill(std::begin(freeLists), std::end(freeLists), nullptr);
+	used = 0;
+}
+
+TlbMissCounter::TlbMissCounter()
+{
+#ifdef __linux__
+	perf_event_attr attr{};
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HW_CACHE;
+	attr.config = PERF_COUNT_HW_CACHE_DTLB | PERF_COUNT_HW_CACHE_OP_READ << 8u | PERF_COUNT_HW_CACHE_RESULT_MISS << 16u;
+	attr.inherit = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	// fails without a PMU or when perf_event_paranoid forbids it, the counter is then unavailable
+	fd = int(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+}
+
+TlbMissCounter::~TlbMissCounter()
+{
+#ifndef _WIN32
+	if (fd >= 0)
+	{
+		close(fd);
+	}
+#endif
+}
+
+uint64_t TlbMissCounter::Read() const
+{
+	uint64_t count = 0;
+#ifndef _WIN32
+	if (fd >= 0 && read(fd, &count, sizeof(count)) != sizeof(count))
+	{
+		count = 0;
+	}
+#endif
+	return count;
+}
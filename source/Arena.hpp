@@ -0,0 +1,125 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <new>
+#include <utility>
+
+// blocks are handed out in multiples of this, which is also the strongest alignment they have
+const size_t ARENA_BLOCK_SIZE = 64;
+// freed blocks up to this size are kept for reuse, larger ones only come back on Reset
+const size_t ARENA_RECYCLE_MAX = 4096;
+
+// Hands out memory from one contiguous region reserved up front, backed by huge pages where the
+// OS allows it, so that thousands of machines and their memory pages sit behind a handful of TLB
+// entries instead of being scattered over the heap. Allocating is a bump of an atomic offset,
+// freed blocks go on a free list for their size, and Reset forgets everything at once. Reset and
+// destruction must only happen once nothing allocated from the arena is alive.
+class Arena
+{
+public:
+    explicit Arena(size_t bytes);
+    ~Arena();
+    Arena(Arena const&) = delete;
+    Arena& operator=(Arena const&) = delete;
+
+    // nullptr once the region is used up, callers fall back to the heap
+    void* Allocate(size_t size);
+    void Free(void* block, size_t size);
+    void Reset();
+
+    bool Owns(void const* block) const
+    {
+        return block >= base && block < base + capacity;
+    }
+
+    template <typename T, typename... Args>
+    T* New(Args&&... args)
+    {
+        static_assert(alignof(T) <= ARENA_BLOCK_SIZE);
+        void* block = Allocate(sizeof(T));
+        return block ? new (block) T(std::forward<Args>(args)...) : nullptr;
+    }
+
+    template <typename T>
+    void Delete(T* object)
+    {
+        object->~T();
+        Free(object, sizeof(T));
+    }
+
+    size_t Capacity() const { return capacity; }
+    // bytes of the region handed out so far, freed blocks included
+    size_t Used() const { return std::min(used.load(), capacity); }
+    // "huge pages", "transparent huge pages" (asked for, up to the kernel) or "pages"
+    char const* Backing() const { return backing; }
+
+private:
+    static size_t Rounded(size_t size) { return (size + ARENA_BLOCK_SIZE - 1) / ARENA_BLOCK_SIZE * ARENA_BLOCK_SIZE; }
+
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    uint8_t* base{};
+    size_t capacity{};
+    char const* backing = "pages";
+    std::atomic<size_t> used{};
+
+    std::mutex freeMutex;
+    FreeBlock* freeLists[ARENA_RECYCLE_MAX / ARENA_BLOCK_SIZE + 1]{};
+};
+
+// std allocator over an arena, for std::allocate_shared and containers. Without an arena, or once
+// it is full, memory comes from the heap as usual.
+template <typename T>
+struct ArenaAllocator
+{
+    using value_type = T;
+
+    explicit ArenaAllocator(Arena* arena) : arena(arena) {}
+    template <typename U>
+    ArenaAllocator(ArenaAllocator<U> const& other) : arena(other.arena) {}
+
+    T* allocate(size_t n)
+    {
+        void* block = arena ? arena->Allocate(n * sizeof(T)) : nullptr;
+        return static_cast<T*>(block ? block : ::operator new(n * sizeof(T)));
+    }
+
+    void deallocate(T* block, size_t n)
+    {
+        if (arena && arena->Owns(block))
+        {
+            arena->Free(block, n * sizeof(T));
+        }
+        else
+        {
+            ::operator delete(block);
+        }
+    }
+
+    template <typename U>
+    bool operator==(ArenaAllocator<U> const& other) const { return arena == other.arena; }
+
+    Arena* arena;
+};
+
+// Data TLB misses of this process, where the OS lets us count them (perf events on Linux). Threads
+// started after construction are counted too once they have exited.
+class TlbMissCounter
+{
+public:
+    TlbMissCounter();
+    ~TlbMissCounter();
+    TlbMissCounter(TlbMissCounter const&) = delete;
+    TlbMissCounter& operator=(TlbMissCounter const&) = delete;
+
+    bool Available() const { return fd >= 0; }
+    uint64_t Read() const;
+
+private:
+    int fd = -1;
+};
@@ -1,13 +1,18 @@
 #include "Chip8.hpp"
+#include "Arena.hpp"
+#include "FaultLog.hpp"
+#include "Hash.hpp"
+#ifdef CHIP8_PROFILE
+#include "Profile.hpp"
+#endif
+#include <csignal>
 #include <cstdint>
 #include <fstream>
 #include <chrono>
-#include <random>
 #include <cstring>
-#include <iostream>
+#include <iterator>
+#include <algorithm>
 
-    const unsigned int START_ADDRESS = 0x200;
-    const unsigned int FONTSET_START_ADDRESS = 0x50;
     const unsigned int FONTSET_SIZE = 80;
     
     uint8_t fontset[FONTSET_SIZE] = 
@@ -38,86 +43,139 @@
         0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
+    RomHandle MakeRomImage(std::span<const uint8_t> rom) {
+        // anything past the end of memory is dropped rather than overrunning it
+        rom = rom.first(rom.size() < ROM_SIZE_MAX ? rom.size() : ROM_SIZE_MAX);
+
+        // empty pages are common to every image
+        static const std::shared_ptr<MemoryPage> zeroPage = std::make_shared<MemoryPage>();
+
+        uint8_t memory[MEMORY_SIZE]{};
+        memcpy(&memory[FONTSET_START_ADDRESS], fontset, FONTSET_SIZE);
+        memcpy(&memory[START_ADDRESS], rom.data(), rom.size());
+
+        auto image = std::make_shared<RomImage>();
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            if(memcmp(&memory[page * PAGE_SIZE], zeroPage->bytes, PAGE_SIZE) == 0) {
+                image->pages[page] = zeroPage;
+            } else {
+                image->pages[page] = std::make_shared<MemoryPage>();
+                memcpy(image->pages[page]->bytes, &memory[page * PAGE_SIZE], PAGE_SIZE);
+            }
+            image->pageHashes[page] = HashBytes(&memory[page * PAGE_SIZE], PAGE_SIZE);
+        }
+#ifdef CHIP8_STATE_HASH
+        for(unsigned int address = 0; address < MEMORY_SIZE; ++address) {
+            image->memoryHash ^= ZobristKey(address, memory[address]);
+        }
+#endif
+        image->hash = HashFnv1a(memory, MEMORY_SIZE);
+
+        return image;
+    }
+
 
 
     Chip8::Chip8() 
     //seed random using system clock
-    : randGen(std::chrono::system_clock::now().time_since_epoch().count()) 
+    : Chip8(std::chrono::system_clock::now().time_since_epoch().count()) 
+    {
+    }
+
+    Chip8::Chip8(uint64_t seed)
     {
         // pc begins outside of reserved memory
         pc = START_ADDRESS;
 
-        // load font into memory
-        for(unsigned int i = 0; i < FONTSET_SIZE; ++i) {
-            memory[FONTSET_START_ADDRESS + i] = fontset[i];
-        }
+        // load font into memory, every machine without a ROM shares the same image
+        static const RomHandle blank = MakeRomImage({});
+        rom = blank;
+        std::copy(std::begin(rom->pages), std::end(rom->pages), pages);
 
         // initialize random
-        randByte = std::uniform_int_distribution<uint8_t>(0,255);
-
-        // function pointer table
-
-        /*
-            The master table is looking at the 4 leftmost bits in the opcode since that determines most of the opcodes.
-            For instructions with multiple options for the respective leftmost hex, 
-            a secondary table looks at the rightmost 4 or 8 bits to determine correct opcode.
-        */
-		table[0x0] = &Chip8::Table0;
-		table[0x1] = &Chip8::OP_1nnn;
-		table[0x2] = &Chip8::OP_2nnn;
-		table[0x3] = &Chip8::OP_3xkk;
-		table[0x4] = &Chip8::OP_4xkk;
-		table[0x5] = &Chip8::OP_5xy0;
-		table[0x6] = &Chip8::OP_6xkk;
-		table[0x7] = &Chip8::OP_7xkk;
-		table[0x8] = &Chip8::Table8;
-		table[0x9] = &Chip8::OP_9xy0;
-		table[0xA] = &Chip8::OP_Annn;
-		table[0xB] = &Chip8::OP_Bnnn;
-		table[0xC] = &Chip8::OP_Cxkk;
-		table[0xD] = &Chip8::OP_Dxyn;
-		table[0xE] = &Chip8::TableE;
-		table[0xF] = &Chip8::TableF;
-
-		for (size_t i = 0; i <= 0xE; i++)
-		{
-			table0[i] = &Chip8::OP_NULL;
-			table8[i] = &Chip8::OP_NULL;
-			tableE[i] = &Chip8::OP_NULL;
-		}
-
-		table0[0x0] = &Chip8::OP_00E0;
-		table0[0xE] = &Chip8::OP_00EE;
-
-		table8[0x0] = &Chip8::OP_8xy0;
-		table8[0x1] = &Chip8::OP_8xy1;
-		table8[0x2] = &Chip8::OP_8xy2;
-		table8[0x3] = &Chip8::OP_8xy3;
-		table8[0x4] = &Chip8::OP_8xy4;
-		table8[0x5] = &Chip8::OP_8xy5;
-		table8[0x6] = &Chip8::OP_8xy6;
-		table8[0x7] = &Chip8::OP_8xy7;
-		table8[0xE] = &Chip8::OP_8xyE;
-
-		tableE[0x1] = &Chip8::OP_ExA1;
-		tableE[0xE] = &Chip8::OP_Ex9E;
-
-		for (size_t i = 0; i <= 0x65; i++)
-		{
-			tableF[i] = &Chip8::OP_NULL;
-		}
-
-		tableF[0x07] = &Chip8::OP_Fx07;
-		tableF[0x0A] = &Chip8::OP_Fx0A;
-		tableF[0x15] = &Chip8::OP_Fx15;
-		tableF[0x18] = &Chip8::OP_Fx18;
-		tableF[0x1E] = &Chip8::OP_Fx1E;
-		tableF[0x29] = &Chip8::OP_Fx29;
-		tableF[0x33] = &Chip8::OP_Fx33;
-		tableF[0x55] = &Chip8::OP_Fx55;
-		tableF[0x65] = &Chip8::OP_Fx65;
-
+        rng.Seed(seed);
+
+#ifdef CHIP8_STATE_HASH
+        Rehash();
+#endif
+    }
+
+    // function pointer table
+
+    /*
+        The master table is looking at the 4 leftmost bits in the opcode since that determines most of the opcodes.
+        For instructions with multiple options for the respective leftmost hex, 
+        a secondary table looks at the rightmost 4 or 8 bits to determine correct opcode.
+    */
+	constinit const std::array<Chip8::Chip8Func, 0xF + 1> Chip8::table = {
+		&Chip8::Table0,
+		&Chip8::OP_1nnn,
+		&Chip8::OP_2nnn,
+		&Chip8::OP_3xkk,
+		&Chip8::OP_4xkk,
+		&Chip8::OP_5xy0,
+		&Chip8::OP_6xkk,
+		&Chip8::OP_7xkk,
+		&Chip8::Table8,
+		&Chip8::OP_9xy0,
+		&Chip8::OP_Annn,
+		&Chip8::OP_Bnnn,
+		&Chip8::OP_Cxkk,
+		&Chip8::OP_Dxyn,
+		&Chip8::TableE,
+		&Chip8::TableF,
+	};
+
+	constinit const std::array<Chip8::Chip8Func, 0xF + 1> Chip8::table0 = [] {
+		std::array<Chip8Func, 0xF + 1> table{};
+		table.fill(&Chip8::OP_NULL);
+		table[0x0] = &Chip8::OP_00E0;
+		table[0xE] = &Chip8::OP_00EE;
+		return table;
+	}();
+
+	constinit const std::array<Chip8::Chip8Func, 0xF + 1> Chip8::table8 = [] {
+		std::array<Chip8Func, 0xF + 1> table{};
+		table.fill(&Chip8::OP_NULL);
+		table[0x0] = &Chip8::OP_8xy0;
+		table[0x1] = &Chip8::OP_8xy1;
+		table[0x2] = &Chip8::OP_8xy2;
+		table[0x3] = &Chip8::OP_8xy3;
+		table[0x4] = &Chip8::OP_8xy4;
+		table[0x5] = &Chip8::OP_8xy5;
+		table[0x6] = &Chip8::OP_8xy6;
+		table[0x7] = &Chip8::OP_8xy7;
+		table[0xE] = &Chip8::OP_8xyE;
+		return table;
+	}();
+
+	constinit const std::array<Chip8::Chip8Func, 0xF + 1> Chip8::tableE = [] {
+		std::array<Chip8Func, 0xF + 1> table{};
+		table.fill(&Chip8::OP_NULL);
+		table[0x1] = &Chip8::OP_ExA1;
+		table[0xE] = &Chip8::OP_Ex9E;
+		return table;
+	}();
+
+	constinit const std::array<Chip8::Chip8Func, 0xFF + 1> Chip8::tableF = [] {
+		std::array<Chip8Func, 0xFF + 1> table{};
+		table.fill(&Chip8::OP_NULL);
+		table[0x07] = &Chip8::OP_Fx07;
+		table[0x0A] = &Chip8::OP_Fx0A;
+		table[0x15] = &Chip8::OP_Fx15;
+		table[0x18] = &Chip8::OP_Fx18;
+		table[0x1E] = &Chip8::OP_Fx1E;
+		table[0x29] = &Chip8::OP_Fx29;
+		table[0x33] = &Chip8::OP_Fx33;
+		table[0x55] = &Chip8::OP_Fx55;
+		table[0x65] = &Chip8::OP_Fx65;
+		return table;
+	}();
+
+    void Chip8::Seed(uint64_t seed) {
+        rng.Seed(seed);
     }
+
     void Chip8::Table0(){
 		((*this).*(table0[opcode & 0x000Fu]))();
 	}
@@ -131,8 +189,167 @@
 		((*this).*(tableF[opcode & 0x00FFu]))();
 	}
 	void Chip8::OP_NULL(){
-        std::cout << "NULL OPCODE CALLED, WHY?" << std::endl;
-        std::cout << "OPCODE: " << std::hex << opcode << std::endl;
+        Raise(Fault::InvalidOpcode, pc - 2);
+    }
+
+#ifdef CHIP8_PROFILE
+    void Chip8::Sample() const
+    {
+        // every return address on the stack follows the call that pushed it, whose target is the subroutine
+        uint16_t callees[STACK_LEVELS];
+        unsigned int depth = std::min<unsigned int>(sp, STACK_LEVELS);
+        for(unsigned int level = 0; level < depth; ++level) {
+            callees[level] = Fetch(stack[level] - 2) & 0x0FFFu;
+        }
+        profile->Count(pc, opcode, std::span<const uint16_t>(callees, depth));
+    }
+#endif
+
+    void Chip8::Raise(Fault kind, uint16_t at)
+    {
+        if(faultPolicy == FaultPolicy::Ignore) {
+            return;
+        }
+        if(fault == Fault::None) {
+            fault = kind;
+        }
+        if(faultPolicy == FaultPolicy::Halt) {
+            stopped = true;
+        }
+        if(faultsMuted) {
+            return;
+        }
+        ++faultCounts[unsigned(kind)];
+        FaultLog::Instance().Record(kind, at, opcode);
+
+        if(faultPolicy == FaultPolicy::Trap) {
+#ifdef _WIN32
+            __debugbreak();
+#else
+            raise(SIGTRAP);
+#endif
+        }
+    }
+
+    void Chip8::RunFrame(unsigned int cycles)
+    {
+        for(unsigned int i = 0; i < cycles; ++i) {
+            Cycle();
+        }
+    }
+
+    bool Chip8::DelayLoop(uint16_t& start) const
+    {
+        // LD Vx, DT / SE Vx, 0 / JP back to the LD, with pc on any of the three
+        for(unsigned int back = 0; back <= 4; back += 2) {
+            uint16_t at = uint16_t(pc - back) % MEMORY_SIZE;
+            uint16_t load = Fetch(at);
+            if((load & 0xF0FFu) == 0xF007u && Fetch(at + 2) == (0x3000u | (load & 0x0F00u)) && Fetch(at + 4) == (0x1000u | at)) {
+                start = at;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t Chip8::IdleCycles() const
+    {
+        if(Halted()) {
+            return IDLE_FOREVER;
+        }
+        if(WaitingForKey()) {
+            return KeyMask() ? 0 : IDLE_FOREVER;
+        }
+
+        uint16_t start;
+        if(!DelayLoop(start)) {
+            return 0;
+        }
+        uint8_t Vx = (Fetch(start) & 0x0F00u) >> 8u;
+
+        // cycles until pc is back on the LD, then from there the loop leaves on the SE of the
+        // first pass that reads 0, and every cycle decrements the timer
+        uint64_t lead;
+        uint64_t delay;
+        switch((pc - start) % MEMORY_SIZE) {
+        case 0:
+            lead = 0;
+            delay = delayTimer;
+            break;
+        case 2:
+            if(registers[Vx] == 0) {
+                return 0;
+            }
+            lead = 2;
+            delay = delayTimer > 2 ? delayTimer - 2 : 0;
+            break;
+        default:
+            lead = 1;
+            delay = delayTimer > 1 ? delayTimer - 1 : 0;
+            break;
+        }
+        return lead + (delay + 2) / 3 * 3 + 1;
+    }
+
+    void Chip8::SkipIdle(uint64_t cycles)
+    {
+        if(cycles == 0) {
+            return;
+        }
+        uint16_t start;
+        if(stopped) {
+            // halted by a fault, even on a delay loop nothing but the timers runs
+        } else if(!DelayLoop(start)) {
+            // Fx0A and a jump to itself fetch themselves again and again
+            opcode = Fetch(pc);
+        } else {
+            // onto the LD first, from there the loop repeats every 3 cycles
+            for(; pc != start && cycles > 0; --cycles) {
+                Cycle();
+            }
+            if(cycles == 0) {
+                return;
+            }
+            uint8_t Vx = (Fetch(start) & 0x0F00u) >> 8u;
+            uint64_t passes = cycles / 3;
+            uint64_t phase = cycles % 3;
+
+            // the last LD ran at the start of the last pass begun, and read the timer as it was then
+            uint64_t lastLoad = (phase ? passes : passes - 1) * 3;
+            registers[Vx] = lastLoad < delayTimer ? delayTimer - lastLoad : 0;
+            pc = (start + 2 * phase) % MEMORY_SIZE;
+            opcode = Fetch((start + 2 * ((phase + 2) % 3)) % MEMORY_SIZE);
+        }
+
+        delayTimer = cycles < delayTimer ? delayTimer - cycles : 0;
+        soundTimer = cycles < soundTimer ? soundTimer - cycles : 0;
+    }
+
+    uint16_t Chip8::KeyMask() const
+    {
+        uint16_t mask = 0;
+        for(unsigned int key = 0; key < KEY_COUNT; ++key) {
+            mask |= (keypad[key] ? 1u : 0u) << key;
+        }
+        return mask;
+    }
+
+    char const* Chip8::FaultName(Fault fault)
+    {
+        switch(fault) {
+            case Fault::StackOverflow: return "stackOverflow";
+            case Fault::StackUnderflow: return "stackUnderflow";
+            case Fault::PcOutOfRange: return "pcOutOfRange";
+            case Fault::InvalidOpcode: return "invalidOpcode";
+            default: return "none";
+        }
+    }
+
+    void Chip8::SetKeys(uint16_t mask)
+    {
+        for(unsigned int key = 0; key < KEY_COUNT; ++key) {
+            keypad[key] = (mask >> key) & 1u;
+        }
     }
 
     void Chip8::Cycle()
@@ -143,14 +360,24 @@
         // }
         // fetch decode execute cycle
 
-        // fetch current opcode (opcodes are 16bit, memory is 1byte per cell)
-        opcode = (memory[pc] << 8u | memory[pc + 1]);
+        if(!stopped) {
+            // fetch current opcode (opcodes are 16bit, memory is 1byte per cell)
+            if(pc > MEMORY_SIZE - 2) {
+                Raise(Fault::PcOutOfRange, pc);
+            }
+            opcode = (Read(pc) << 8u | Read(pc + 1));
+#ifdef CHIP8_PROFILE
+            if(profile) {
+                Sample();
+            }
+#endif
 
-        pc+=2;
+            pc+=2;
 
-        // decode + execute
-        // call function at first digit table
-        ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+            // decode + execute
+            // call function at first digit table
+            ((*this).*(table[(opcode & 0xF000u) >> 12u]))();
+        }
 
         // decrement delay if set
         if(delayTimer > 0){
@@ -167,44 +394,95 @@
 
     void Chip8::LoadROM(char const* filename) {
 
-        // open file in binary mode, output position at end of file
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        // open file in binary mode
+        std::ifstream file(filename, std::ios::binary);
 
         if(file.is_open()) {
 
-            // get filesize by reading position at eof
-            std::streampos size = file.tellg();
-            // buffer of file size
-            char* buffer = new char[size];
-
-            // return to start and read into buffer
-            file.seekg(0, std::ios::beg);
-            file.read(buffer,size);
-            file.close();
+            // anything past ROM_SIZE_MAX would be dropped anyway, so a fixed buffer on the stack will do
+            uint8_t buffer[ROM_SIZE_MAX];
+            file.read(reinterpret_cast<char*>(buffer), ROM_SIZE_MAX);
 
             // load file into memory
-            for(long i = 0; i < size; ++i) {
+            LoadROM(std::span<const uint8_t>(buffer, size_t(file.gcount())));
+
+        }
 
-                memory[START_ADDRESS + i] = buffer[i];
+    }
 
-            }
+    void Chip8::LoadROM(std::span<const uint8_t> rom) {
+        // keep the pristine image around, savestates are stored relative to it
+        this->rom = MakeRomImage(rom);
+        std::copy(std::begin(this->rom->pages), std::end(this->rom->pages), pages);
+#ifdef CHIP8_STATE_HASH
+        Rehash();
+#endif
+    }
+
+    void Chip8::Reset() {
+        std::copy(std::begin(rom->pages), std::end(rom->pages), pages);
+        memset(registers, 0, sizeof(registers));
+        index = 0;
+        pc = START_ADDRESS;
+        opcode = 0;
+        delayTimer = 0;
+        soundTimer = 0;
+        sp = 0;
+        memset(stack, 0, sizeof(stack));
+        memset(video, 0, sizeof(video));
+        memset(keypad, 0, sizeof(keypad));
+        stopped = false;
+        fault = Fault::None;
+        memset(faultCounts, 0, sizeof(faultCounts));
+#ifdef CHIP8_STATE_HASH
+        Rehash();
+#endif
+    }
 
-            delete[] buffer;
+    void Chip8::Reset(RomHandle rom) {
+        this->rom = std::move(rom);
+        Reset();
+    }
 
+    uint8_t& Chip8::Write(unsigned int address) {
+        std::shared_ptr<MemoryPage>& page = pages[(address / PAGE_SIZE) % PAGE_COUNT];
+
+        // copy on write, the page may still be shared with the ROM image or a clone
+        if(page.use_count() > 1) {
+            page = std::allocate_shared<MemoryPage>(ArenaAllocator<MemoryPage>(arena), *page);
         }
 
+        return page->bytes[address % PAGE_SIZE];
+    }
+
+    void Chip8::Store(unsigned int address, uint8_t value) {
+        uint8_t& byte = Write(address);
+#ifdef CHIP8_STATE_HASH
+        memoryHash ^= ZobristKey(address % MEMORY_SIZE, byte) ^ ZobristKey(address % MEMORY_SIZE, value);
+#endif
+        byte = value;
     }
 
     // INSTRUCTIONS:
     void Chip8::OP_00E0() {
         // cls | clear screen
+#ifdef CHIP8_STATE_HASH
+        for(unsigned int row = 0; row < VIDEO_HEIGHT; ++row) {
+            if(video[row]) {
+                videoHash ^= ZobristKey(MEMORY_SIZE + row, video[row]) ^ ZobristKey(MEMORY_SIZE + row, 0);
+            }
+        }
+#endif
         memset(video, 0, sizeof(video));
     }
 
     void Chip8::OP_00EE() {
         // ret | return
+        if(sp == 0) {
+            Raise(Fault::StackUnderflow, pc - 2);
+        }
         --sp;
-        pc = stack[sp];
+        pc = stack[sp % STACK_LEVELS];
         
     }
 
@@ -218,7 +496,10 @@
         // call subroutine at nnn
         uint16_t address = opcode & 0x0FFFu;
 
-        stack[sp] = pc;
+        if(sp >= STACK_LEVELS) {
+            Raise(Fault::StackOverflow, pc - 2);
+        }
+        stack[sp % STACK_LEVELS] = pc;
         ++sp;
         pc = address;
         
@@ -363,7 +644,8 @@
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
 	    uint8_t byte = opcode & 0x00FFu;
 
-        registers[Vx] = randByte(randGen) & byte;
+        // top bits of xoshiro output are the strongest
+        registers[Vx] = (rng.Next() >> 24u) & byte;
     }
     void Chip8::OP_Dxyn() {
         // draw n-byte sprite starting at memory location index at (Vx,Vy), set VF = collision
@@ -376,26 +658,25 @@
 
         registers[0xF] = 0;
 
-        for(unsigned int row = 0; row < height; ++row) {
-            uint8_t spriteByte = memory[index + row];
-
-            for(unsigned int col = 0; col < 8; ++col){
-
-                uint8_t spritePixel = spriteByte & (0x80u >> col);
-                uint32_t* screenPixel = &video[(yPos + row) * VIDEO_WIDTH + (xPos + col)];
+        // sprites are clipped at the right and bottom edges
+        for(unsigned int row = 0; row < height && yPos + row < VIDEO_HEIGHT; ++row) {
+            uint8_t spriteByte = Read(index + row);
 
-                if(spritePixel){
-                    // when the sprite pixel should be on, check if that pixel is already turned on in video.
-                    if (*screenPixel == 0xFFFFFFFF){
-                        // pixel is already on, collision flag set
-                        registers[0xF] = 1;
-                    }
-                    // set the pixel to the XOR of itself, effectively toggling it
-                    *screenPixel ^= 0xFFFFFFFF;
-                }
+            // line the 8 sprite pixels up with the screen row, anything past the right edge is shifted out
+            uint64_t spriteRow = (uint64_t(spriteByte) << (VIDEO_WIDTH - 8)) >> xPos;
+            uint64_t& screenRow = video[yPos + row];
 
+            // pixel already on where the sprite is drawn, collision flag set
+            if(screenRow & spriteRow) {
+                registers[0xF] = 1;
             }
-
+            // toggle the sprite pixels
+#ifdef CHIP8_STATE_HASH
+            if(spriteRow) {
+                videoHash ^= ZobristKey(MEMORY_SIZE + yPos + row, screenRow) ^ ZobristKey(MEMORY_SIZE + yPos + row, screenRow ^ spriteRow);
+            }
+#endif
+            screenRow ^= spriteRow;
         }
     }
 
@@ -403,7 +684,8 @@
         // skip next instruction if key value Vx is pressed.
 
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	    uint8_t key = registers[Vx];
+        // only the low nibble names a key, Vx past F would read past the keypad
+        uint8_t key = registers[Vx] & 0xFu;
 
         if(keypad[key]) {
             pc+= 2;
@@ -414,7 +696,7 @@
     void Chip8::OP_ExA1() {
         // skip next instruction if key Vx is not pressed
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
-	    uint8_t key = registers[Vx];
+        uint8_t key = registers[Vx] & 0xFu;
         if(!keypad[key]) {
             pc+= 2;
         }
@@ -519,20 +801,20 @@
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         uint8_t number = registers[Vx];
         
-        memory[index + 2] = number % 10;
+        Store(index + 2, number % 10);
         number /= 10;
 
-        memory[index + 1] = number % 10;
+        Store(index + 1, number % 10);
         number /= 10;
 
-        memory[index] = number % 10;
+        Store(index, number % 10);
     }
 
     void Chip8::OP_Fx55() {
         // store registers v0 to vx into memory starting at index.
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         for(uint8_t i = 0; i <= Vx; ++i) {
-            memory[index + i] = registers[i];
+            Store(index + i, registers[i]);
         }
 
     }
@@ -541,7 +823,7 @@
         // reads memory into registers v0 to vx starting at index.
         uint8_t Vx = (opcode & 0x0F00u) >> 8u;
         for(uint8_t i = 0; i <= Vx; ++i) {
-            registers[i] = memory[index + i];
+            registers[i] = Read(index + i);
         }
     }
 
@@ -1,5 +1,10 @@
+#pragma once
+#include "Rng.hpp"
+#include <array>
 #include <cstdint>
-#include <random> 
+#include <memory>
+#include <span>
+#include <vector>
 
 const unsigned int KEY_COUNT = 16;
 const unsigned int MEMORY_SIZE = 4096;
@@ -7,16 +12,175 @@ const unsigned int REGISTER_COUNT = 16;
 const unsigned int STACK_LEVELS = 16;
 const unsigned int VIDEO_HEIGHT = 32;
 const unsigned int VIDEO_WIDTH = 64;
+const unsigned int START_ADDRESS = 0x200;
+const unsigned int FONTSET_START_ADDRESS = 0x50;
+const unsigned int ROM_SIZE_MAX = MEMORY_SIZE - START_ADDRESS;
+const unsigned int PAGE_SIZE = 256;
+const unsigned int PAGE_COUNT = MEMORY_SIZE / PAGE_SIZE;
+
+class Arena;
+#ifdef CHIP8_PROFILE
+class Profile;
+#endif
+
+// memory is split into pages shared between machines until one of them writes to it
+struct MemoryPage {
+    uint8_t bytes[PAGE_SIZE]{};
+};
+
+// power-on memory contents (font + ROM), shared by every machine running the same ROM
+struct RomImage {
+    std::shared_ptr<MemoryPage> pages[PAGE_COUNT];
+    uint64_t hash{};
+    // HashBytes of every page, so that pages machines still share with the image needn't be hashed again
+    uint64_t pageHashes[PAGE_COUNT]{};
+#ifdef CHIP8_STATE_HASH
+    // Zobrist hash of the whole image, where every machine's memory hash starts
+    uint64_t memoryHash{};
+#endif
+
+    uint8_t Read(unsigned int address) const { return pages[address / PAGE_SIZE]->bytes[address % PAGE_SIZE]; }
+};
+
+// a loaded ROM, cheap to copy and safe to share between threads
+using RomHandle = std::shared_ptr<const RomImage>;
+
+// font plus ROM, anything past ROM_SIZE_MAX is dropped
+RomHandle MakeRomImage(std::span<const uint8_t> rom);
 
 class Chip8 {
+    // hot state first so that most instructions touch a single cache line
+    alignas(64) uint8_t registers[REGISTER_COUNT]{};
+	uint16_t index{};
+	uint16_t pc{};
+	uint16_t opcode{};
+	uint8_t delayTimer{};
+	uint8_t soundTimer{};
+	uint8_t sp{};
+	// halted by a fault under FaultPolicy::Halt, only the timers run
+	bool stopped{};
+	uint16_t stack[STACK_LEVELS]{};
 
 public:
+    // Things a broken ROM does: call deeper than the stack goes, return with nothing on it, run off
+    // the end of memory, run an opcode that doesn't exist. The machine carries on the way the
+    // lockstep engine does, with the stack pointer, pc and key numbers wrapping around and bad
+    // opcodes doing nothing, unless the fault policy says otherwise.
+    enum class Fault : uint8_t { None, StackOverflow, StackUnderflow, PcOutOfRange, InvalidOpcode };
+    static const unsigned int FAULT_KINDS = 5;
+    static char const* FaultName(Fault fault);
+
+    // raw copy of all machine state, cheap to take and restore every frame
+    struct Snapshot {
+        uint8_t memory[MEMORY_SIZE];
+        uint8_t registers[REGISTER_COUNT];
+        uint16_t index;
+        uint16_t pc;
+        uint8_t delayTimer;
+        uint8_t soundTimer;
+        uint16_t stack[STACK_LEVELS];
+        uint8_t sp;
+        uint64_t video[VIDEO_HEIGHT];
+        Rng rng;
+        // halted by a fault and the first fault, going back to a halted state stays halted
+        bool stopped;
+        Fault fault;
+    };
+
+    // seeded from the clock, use the seeded constructor for reproducible runs
     Chip8();
+    explicit Chip8(uint64_t seed);
+    void Seed(uint64_t seed);
     void LoadROM(char const* filename);
+    void LoadROM(std::span<const uint8_t> rom);
+    // back to power-on state without touching the RNG (Seed it to repeat a run), memory shares the
+    // ROM image's pages again so nothing is copied; the second form also switches to another ROM
+    void Reset();
+    void Reset(RomHandle rom);
     void Cycle();
+    // a frame is a fixed number of cycles run with the same keys held, nothing is drawn
+    void RunFrame(unsigned int cycles);
+
+    // How many of the next cycles only count the timers down: all of them (IDLE_FOREVER) on a jump to
+    // itself or while Fx0A waits with no key held, until the delay timer runs out in a Fx07 / 3x00 /
+    // 1nnn spin loop, 0 otherwise. SkipIdle(n) with n up to that leaves the machine exactly as n Cycles would.
+    static const uint64_t IDLE_FOREVER = UINT64_MAX;
+    // on a jump to itself, which is how most programs halt, or stopped by a fault
+    bool Halted() const { return stopped || Fetch(pc) == (0x1000u | pc); }
+    // on Fx0A, which stays put until a key is held
+    bool WaitingForKey() const { return (Fetch(pc) & 0xF0FFu) == 0xF00Au; }
+    uint64_t IdleCycles() const;
+    void SkipIdle(uint64_t cycles);
+
+    // Ignore: carry on as if nothing happened. Count (the default): count the fault, send it to the
+    // FaultLog and carry on. Halt: the same, then stop running instructions (Halted() turns true,
+    // the timers keep running) until Reset or a Restore of a state that wasn't halted. Trap: the
+    // same, then break into the debugger, which without one attached ends the process.
+    enum class FaultPolicy : uint8_t { Ignore, Count, Halt, Trap };
+    void SetFaultPolicy(FaultPolicy policy) { faultPolicy = policy; }
+    // for frames being run again: faults still halt under Halt and are still the first fault, but
+    // they aren't counted, logged or trapped on a second time
+    void MuteFaults(bool muted) { faultsMuted = muted; }
+    // the first fault since power-on or Reset (a Restore brings back the one of the state), and how
+    // many of a kind there were since power-on or Reset, both left alone under FaultPolicy::Ignore
+    Fault FirstFault() const { return fault; }
+    uint64_t FaultCount(Fault fault) const { return faultCounts[unsigned(fault)]; }
+
+    // keypad as a bit mask, bit n set while key n is held
+    uint16_t KeyMask() const;
+    void SetKeys(uint16_t mask);
+
+    // identifies the loaded ROM (FNV-1a of the power-on memory image)
+    uint64_t RomHash() const { return rom->hash; }
+    // hash of everything Snapshot holds, equal states always hash equal
+    uint64_t StateHash() const;
+    // memory, registers, timers, stack and screen but not the RNG, so states a program can't tell
+    // apart hash equal. Built with CHIP8_STATE_HASH, memory and screen hashes are kept up to date as
+    // they change and this is O(1); otherwise only pages still shared with the ROM are skipped.
+    // Values differ between the two, compare them only within one build.
+    uint64_t ContentHash() const;
+    // ContentHash plus the RNG: with the same keys held, machines hashing equal run on identically,
+    // which is what loop detection compares
+    uint64_t CycleHash() const;
+
+    // independent copy that shares memory pages and the ROM image with this one until either writes,
+    // so forking a machine costs a few hundred bytes instead of its whole memory
+    Chip8 Clone() const { return *this; }
+
+    // pages copied on write come from the arena instead of the heap (nullptr goes back to the heap),
+    // copies of the machine use the same arena, which has to outlive them
+    void UseArena(Arena* arena) { this->arena = arena; }
+#ifdef CHIP8_PROFILE
+    // every instruction run from now on is counted into the profile, copies of the machine count
+    // into it too; nullptr counts nothing
+    void UseProfile(Profile* profile) { this->profile = profile; }
+#endif
+
+    void Capture(Snapshot& snapshot) const;
+    void Restore(Snapshot const& snapshot);
+    // compact versioned blob, memory is stored as a delta against the loaded ROM image
+    std::vector<uint8_t> SaveState() const;
+    // returns false (leaving the machine untouched) if the blob is invalid or was saved from another ROM
+    bool LoadState(std::span<const uint8_t> blob);
+
+    bool Pixel(unsigned int x, unsigned int y) const { return (video[y] >> (VIDEO_WIDTH - 1 - x)) & 1u; }
+    // memory as the program sees it, for watching game variables from outside
+    uint8_t Peek(unsigned int address) const { return Read(address); }
+
     uint8_t keypad[KEY_COUNT]{};
-	uint32_t video[VIDEO_WIDTH * VIDEO_HEIGHT]{};
+    // one bit per pixel, the most significant bit of each row is its leftmost pixel
+	uint64_t video[VIDEO_HEIGHT]{};
 private:
+    uint8_t Read(unsigned int address) const {
+        return pages[(address / PAGE_SIZE) % PAGE_COUNT]->bytes[address % PAGE_SIZE];
+    }
+    uint8_t& Write(unsigned int address);
+    // Write for instructions, keeps the memory hash current
+    void Store(unsigned int address, uint8_t value);
+    uint16_t Fetch(unsigned int address) const { return Read(address) << 8u | Read(address + 1); }
+    // start of the delay timer spin loop pc is in, if it is in one
+    bool DelayLoop(uint16_t& start) const;
+
     void Table0();
     void Table8();
     void TableE();
@@ -126,25 +290,39 @@ private:
 	// LD Vx, [I]
 	void OP_Fx65();
 
-    uint8_t memory[MEMORY_SIZE]{};
-	uint8_t registers[REGISTER_COUNT]{};
-	uint16_t index{};
-	uint16_t pc{};
-	uint8_t delayTimer{};
-	uint8_t soundTimer{};
-	uint16_t stack[STACK_LEVELS]{};
-	uint8_t sp{};
-	uint16_t opcode{};
-
-    std::default_random_engine randGen;
-	std::uniform_int_distribution<uint8_t> randByte;
-
+    std::shared_ptr<MemoryPage> pages[PAGE_COUNT];
+
+    RomHandle rom;
+
+    Rng rng;
+    Arena* arena{};
+    FaultPolicy faultPolicy{FaultPolicy::Count};
+    bool faultsMuted{};
+    Fault fault{};
+    uint64_t faultCounts[FAULT_KINDS]{};
+#ifdef CHIP8_PROFILE
+    Profile* profile{};
+    void Sample() const;
+#endif
+    // pc is where the faulting instruction is, the slow path of every check
+    void Raise(Fault fault, uint16_t pc);
+
+#ifdef CHIP8_STATE_HASH
+    // XOR of ZobristKey over every memory byte and every screen row, updated by Store, Dxyn and
+    // 00E0; Rehash starts over after memory or screen were replaced wholesale
+    uint64_t memoryHash{};
+    uint64_t videoHash{};
+    void Rehash();
+#endif
+
+    // shared by every machine and filled in at compile time, so constructing one costs nothing; one
+    // entry for every value a table is indexed with, so garbage opcodes land on OP_NULL instead of
+    // past a table (operands are the handlers' business: Ex9E/ExA1 mask Vx to a key)
     typedef void (Chip8::*Chip8Func)();
-	Chip8Func table[0xF + 1];
-	Chip8Func table0[0xE + 1];
-	Chip8Func table8[0xE + 1];
-	Chip8Func tableE[0xE + 1];
-	Chip8Func tableF[0x65 + 1];
-
+	static const std::array<Chip8Func, 0xF + 1> table;
+	static const std::array<Chip8Func, 0xF + 1> table0;
+	static const std::array<Chip8Func, 0xF + 1> table8;
+	static const std::array<Chip8Func, 0xF + 1> tableE;
+	static const std::array<Chip8Func, 0xFF + 1> tableF;
 
 };
\ No newline at end of file
@@ -0,0 +1,225 @@
+#include "Chip8Env.h"
+#include "Chip8.hpp"
+#include "Hash.hpp"
+#include "RomCache.hpp"
+#include "WorkStealing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// tasks per worker for every step, a few more than one evens out machines that run slower
+const unsigned int CHUNKS_PER_THREAD = 4;
+
+struct chip8_env
+{
+	chip8_env(RomHandle rom, unsigned int n, uint64_t seed, unsigned int cyclesPerFrame, unsigned int threads)
+		: rom(std::move(rom)),
+		  machines(n, Chip8(0)),
+		  episodes(n),
+		  seed(seed),
+		  cyclesPerFrame(cyclesPerFrame),
+		  pool(threads),
+		  observations(size_t(n) * VIDEO_HEIGHT),
+		  rewards(n)
+	{
+	}
+
+	// runs fn(i) for every environment, spread over the pool
+	template <typename F>
+	void ForEach(F fn)
+	{
+		size_t n = machines.size();
+		size_t chunk = std::max<size_t>(1, n / (pool.Threads() * CHUNKS_PER_THREAD));
+		// a throw on a worker would terminate, the first one is carried back to this thread
+		std::exception_ptr failure;
+		std::mutex failureLock;
+		try
+		{
+			for (size_t first = 0; first < n; first += chunk)
+			{
+				size_t last = std::min(n, first + chunk);
+				pool.Submit([&fn, &failure, &failureLock, first, last](unsigned int)
+				{
+					try
+					{
+						for (size_t i = first; i < last; ++i)
+						{
+							fn(i);
+						}
+					}
+					catch (...)
+					{
+						std::lock_guard<std::mutex> lock(failureLock);
+						if (!failure)
+						{
+							failure = std::current_exception();
+						}
+					}
+				});
+			}
+		}
+		catch (...)
+		{
+			// the tasks already queued use fn, which is about to go away
+			pool.Wait();
+			throw;
+		}
+		pool.Wait();
+		if (failure)
+		{
+			std::rethrow_exception(failure);
+		}
+	}
+
+	void Observe(size_t i)
+	{
+		memcpy(&observations[i * VIDEO_HEIGHT], machines[i].video, sizeof(machines[i].video));
+	}
+
+	int64_t RewardValue(size_t i) const
+	{
+		int64_t value = 0;
+		for (unsigned int byte = 0; byte < rewardWidth; ++byte)
+		{
+			value = value << 8u | machines[i].Peek((rewardAddress + byte) % MEMORY_SIZE);
+		}
+		return value;
+	}
+
+	RomHandle rom;
+	std::vector<Chip8> machines;
+	std::vector<uint64_t> episodes;
+	uint64_t seed;
+	unsigned int cyclesPerFrame;
+	WorkStealingPool pool;
+
+	std::vector<uint64_t> observations;
+	std::vector<float> rewards;
+	unsigned int rewardAddress{};
+	unsigned int rewardWidth{};
+	float rewardScale{};
+};
+
+chip8_env* chip8_env_create(unsigned int n, char const* rom_path, uint64_t seed, unsigned int cycles_per_frame,
+	unsigned int threads)
+{
+	if (!rom_path || n == 0)
+	{
+		return nullptr;
+	}
+	try
+	{
+		RomHandle rom = RomCache::Instance().Get(rom_path);
+		if (!rom)
+		{
+			return nullptr;
+		}
+
+		threads = threads ? threads : std::max(1u, std::thread::hardware_concurrency());
+		std::unique_ptr<chip8_env> env = std::make_unique<chip8_env>(rom, n, seed, cycles_per_frame, std::min(threads, n));
+		if (chip8_env_reset(env.get(), nullptr) != CHIP8_ENV_OK)
+		{
+			return nullptr;
+		}
+		return env.release();
+	}
+	catch (...)
+	{
+		// out of memory or threads
+		return nullptr;
+	}
+}
+
+void chip8_env_destroy(chip8_env* env)
+{
+	delete env;
+}
+
+unsigned int chip8_env_count(chip8_env const* env)
+{
+	return env ? unsigned(env->machines.size()) : 0;
+}
+
+int chip8_env_reset(chip8_env* env, uint8_t const* mask)
+{
+	if (!env)
+	{
+		return CHIP8_ENV_ERROR;
+	}
+	try
+	{
+		env->ForEach([env, mask](size_t i)
+		{
+			if (mask && !mask[i])
+			{
+				return;
+			}
+			// the ROM's pages are shared again, nothing is loaded or copied
+			env->machines[i].Reset(env->rom);
+			env->machines[i].Seed(HashMix(env->seed ^ HashMix(i) ^ HashMix(env->episodes[i]++ << 32u)));
+			env->rewards[i] = 0;
+			env->Observe(i);
+		});
+		return CHIP8_ENV_OK;
+	}
+	catch (...)
+	{
+		return CHIP8_ENV_ERROR;
+	}
+}
+
+int chip8_env_step(chip8_env* env, uint16_t const* actions, unsigned int frames)
+{
+	if (!env || !actions)
+	{
+		return CHIP8_ENV_ERROR;
+	}
+	try
+	{
+		env->ForEach([env, actions, frames](size_t i)
+		{
+			Chip8& machine = env->machines[i];
+			int64_t before = env->RewardValue(i);
+
+			machine.SetKeys(actions[i]);
+			for (unsigned int frame = 0; frame < frames; ++frame)
+			{
+				machine.RunFrame(env->cyclesPerFrame);
+			}
+
+			env->rewards[i] = float(env->RewardValue(i) - before) * env->rewardScale;
+			env->Observe(i);
+		});
+		return CHIP8_ENV_OK;
+	}
+	catch (...)
+	{
+		return CHIP8_ENV_ERROR;
+	}
+}
+
+uint64_t const* chip8_env_observations(chip8_env const* env)
+{
+	return env ? env->observations.data() : nullptr;
+}
+
+int chip8_env_set_reward(chip8_env* env, unsigned int address, unsigned int width, float scale)
+{
+	if (!env || width == 0 || width > 4)
+	{
+		return CHIP8_ENV_ERROR;
+	}
+	env->rewardAddress = address;
+	env->rewardWidth = width;
+	env->rewardScale = scale;
+	return CHIP8_ENV_OK;
+}
+
+float const* chip8_env_rewards(chip8_env const* env)
+{
+	return env ? env->rewards.data() : nullptr;
+}
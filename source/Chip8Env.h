@@ -0,0 +1,68 @@
+#ifndef CHIP8_ENV_H
+#define CHIP8_ENV_H
+
+/*
+    C API for running many machines as reinforcement learning environments, from C or through
+    Python's ctypes. All environments run the same ROM and are stepped together on a thread pool.
+
+    Observations and rewards live in buffers owned by the library that stay at the same address
+    for the lifetime of the handle, so they can be wrapped once without copying, e.g. with
+    numpy.ctypeslib.as_array(lib.chip8_env_observations(env), shape=(n, 32)).
+
+    No C++ exception leaves the library. Functions that return an int give CHIP8_ENV_OK or
+    CHIP8_ENV_ERROR, which also covers a NULL handle or buffer; the others return NULL or 0 then.
+*/
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#define CHIP8_ENV_API __declspec(dllexport)
+#else
+#define CHIP8_ENV_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CHIP8_ENV_OK 0
+#define CHIP8_ENV_ERROR (-1)
+
+typedef struct chip8_env chip8_env;
+
+/* NULL if the ROM can't be read or the environments can't be set up. threads = 0 uses every core. */
+CHIP8_ENV_API chip8_env* chip8_env_create(unsigned int n, char const* rom_path, uint64_t seed,
+    unsigned int cycles_per_frame, unsigned int threads);
+/* NULL is ignored */
+CHIP8_ENV_API void chip8_env_destroy(chip8_env* env);
+
+CHIP8_ENV_API unsigned int chip8_env_count(chip8_env const* env);
+
+/*
+    Puts the environments with a nonzero entry in mask (all of them for NULL) back to power-on,
+    each with a fresh seed, and updates their observations.
+*/
+CHIP8_ENV_API int chip8_env_reset(chip8_env* env, uint8_t const* mask);
+
+/*
+    Holds actions[i] (a key mask, bit k for key k) on environment i for the given number of frames,
+    then updates observations and rewards.
+*/
+CHIP8_ENV_API int chip8_env_step(chip8_env* env, uint16_t const* actions, unsigned int frames);
+
+/* n frames of 32 rows, one bit per pixel, the most significant bit of a row is its leftmost pixel */
+CHIP8_ENV_API uint64_t const* chip8_env_observations(chip8_env const* env);
+
+/*
+    Reward for the last step of each environment: how much the big-endian value of `width` bytes
+    (1 to 4) at `address` grew during the step, times scale. Any other width is an error and keeps
+    the previous hook. Without a hook rewards stay 0.
+*/
+CHIP8_ENV_API int chip8_env_set_reward(chip8_env* env, unsigned int address, unsigned int width, float scale);
+CHIP8_ENV_API float const* chip8_env_rewards(chip8_env const* env);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,376 @@
+#include "Chip8.hpp"
+#include "Hash.hpp"
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+    /*
+        Savestate layout (all multi-byte values little endian):
+
+        "C8SS"                  magic
+        u8                      version
+        u64                     hash of the ROM image the state was saved from
+        u8[16]                  registers
+        u16 u16                 index, pc
+        u8 u8                   delay timer, sound timer
+        u16[16] u8              stack, sp
+        u8[256]                 video, one bit per pixel
+        u16                     number of memory runs, followed by
+            u16 u16 u8[length]  offset, length and bytes of memory that differs from the ROM image
+        u32[4]                  random generator state
+                                (version 1 stored the old std engine as u8 length + text, which is skipped)
+        u8 u8                   halted by a fault, first fault (since version 3)
+    */
+    const uint8_t SAVESTATE_MAGIC[4] = { 'C', '8', 'S', 'S' };
+    const uint8_t SAVESTATE_VERSION = 3;
+
+    // runs closer together than this are merged, a new run costs 4 bytes of header
+    const unsigned int RUN_MERGE_GAP = 4;
+
+namespace {
+
+    struct BlobWriter {
+        std::vector<uint8_t>& out;
+
+        void U8(uint8_t value) {
+            out.push_back(value);
+        }
+        void U16(uint16_t value) {
+            out.push_back(value & 0xFFu);
+            out.push_back(value >> 8u);
+        }
+        void U32(uint32_t value) {
+            for(unsigned int i = 0; i < 4; ++i) {
+                out.push_back((value >> (8u * i)) & 0xFFu);
+            }
+        }
+        void U64(uint64_t value) {
+            for(unsigned int i = 0; i < 8; ++i) {
+                out.push_back((value >> (8u * i)) & 0xFFu);
+            }
+        }
+        void Bytes(void const* data, size_t size) {
+            uint8_t const* bytes = static_cast<uint8_t const*>(data);
+            out.insert(out.end(), bytes, bytes + size);
+        }
+    };
+
+    struct BlobReader {
+        std::span<const uint8_t> in;
+        size_t pos{};
+        bool ok = true;
+
+        bool Has(size_t size) {
+            ok = ok && (in.size() - pos >= size);
+            return ok;
+        }
+        uint8_t U8() {
+            return Has(1) ? in[pos++] : 0;
+        }
+        uint16_t U16() {
+            if(!Has(2)) {
+                return 0;
+            }
+            uint16_t value = in[pos] | (in[pos + 1] << 8u);
+            pos += 2;
+            return value;
+        }
+        uint32_t U32() {
+            if(!Has(4)) {
+                return 0;
+            }
+            uint32_t value = 0;
+            for(unsigned int i = 0; i < 4; ++i) {
+                value |= uint32_t(in[pos + i]) << (8u * i);
+            }
+            pos += 4;
+            return value;
+        }
+        uint64_t U64() {
+            if(!Has(8)) {
+                return 0;
+            }
+            uint64_t value = 0;
+            for(unsigned int i = 0; i < 8; ++i) {
+                value |= uint64_t(in[pos + i]) << (8u * i);
+            }
+            pos += 8;
+            return value;
+        }
+        void Bytes(void* data, size_t size) {
+            if(Has(size)) {
+                memcpy(data, &in[pos], size);
+                pos += size;
+            }
+        }
+    };
+
+}
+
+    void Chip8::Capture(Snapshot& snapshot) const {
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            memcpy(&snapshot.memory[page * PAGE_SIZE], pages[page]->bytes, PAGE_SIZE);
+        }
+        memcpy(snapshot.registers, registers, sizeof(registers));
+        snapshot.index = index;
+        snapshot.pc = pc;
+        snapshot.delayTimer = delayTimer;
+        snapshot.soundTimer = soundTimer;
+        memcpy(snapshot.stack, stack, sizeof(stack));
+        snapshot.sp = sp;
+        memcpy(snapshot.video, video, sizeof(video));
+        snapshot.rng = rng;
+        snapshot.stopped = stopped;
+        snapshot.fault = fault;
+    }
+
+    void Chip8::Restore(Snapshot const& snapshot) {
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            uint8_t const* bytes = &snapshot.memory[page * PAGE_SIZE];
+
+            // untouched pages stay shared, pages that match the ROM again go back to sharing it
+            if(memcmp(pages[page]->bytes, bytes, PAGE_SIZE) == 0) {
+                continue;
+            }
+            if(memcmp(rom->pages[page]->bytes, bytes, PAGE_SIZE) == 0) {
+                pages[page] = rom->pages[page];
+                continue;
+            }
+            memcpy(&Write(page * PAGE_SIZE), bytes, PAGE_SIZE);
+        }
+        memcpy(registers, snapshot.registers, sizeof(registers));
+        index = snapshot.index;
+        pc = snapshot.pc;
+        delayTimer = snapshot.delayTimer;
+        soundTimer = snapshot.soundTimer;
+        memcpy(stack, snapshot.stack, sizeof(stack));
+        sp = snapshot.sp;
+        memcpy(video, snapshot.video, sizeof(video));
+        rng = snapshot.rng;
+        stopped = snapshot.stopped;
+        fault = snapshot.fault;
+#ifdef CHIP8_STATE_HASH
+        Rehash();
+#endif
+    }
+
+#ifdef CHIP8_STATE_HASH
+    void Chip8::Rehash() {
+        // only pages no longer shared with the ROM image differ from its hash
+        memoryHash = rom->memoryHash;
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            if(pages[page] == rom->pages[page]) {
+                continue;
+            }
+            for(unsigned int offset = 0; offset < PAGE_SIZE; ++offset) {
+                uint8_t was = rom->pages[page]->bytes[offset];
+                uint8_t is = pages[page]->bytes[offset];
+                if(was != is) {
+                    memoryHash ^= ZobristKey(page * PAGE_SIZE + offset, was) ^ ZobristKey(page * PAGE_SIZE + offset, is);
+                }
+            }
+        }
+
+        videoHash = 0;
+        for(unsigned int row = 0; row < VIDEO_HEIGHT; ++row) {
+            videoHash ^= ZobristKey(MEMORY_SIZE + row, video[row]);
+        }
+    }
+#endif
+
+    uint64_t Chip8::StateHash() const {
+        // fields are hashed one by one, Snapshot has padding that isn't guaranteed to be zero
+        uint64_t hash = 0;
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            hash = HashBytes(pages[page]->bytes, PAGE_SIZE, hash);
+        }
+
+        uint8_t scalars[] = {
+            uint8_t(index), uint8_t(index >> 8u), uint8_t(pc), uint8_t(pc >> 8u), delayTimer, soundTimer, sp
+        };
+        hash = HashBytes(registers, sizeof(registers), hash);
+        hash = HashBytes(scalars, sizeof(scalars), hash);
+        hash = HashBytes(stack, sizeof(stack), hash);
+        hash = HashBytes(video, sizeof(video), hash);
+        hash = HashBytes(rng.state, sizeof(rng.state), hash);
+        // only a halted machine mixes this in, hashes recorded in movies before faults existed still match
+        return stopped ? HashMix(hash ^ uint64_t(fault)) : hash;
+    }
+
+    uint64_t Chip8::ContentHash() const {
+#ifdef CHIP8_STATE_HASH
+        // memory and screen are tracked as they change, only the few dozen bytes of registers are hashed here
+        uint64_t hash = memoryHash ^ HashMix(videoHash);
+#else
+        uint64_t hash = 0;
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            uint64_t pageHash = pages[page] == rom->pages[page] ? rom->pageHashes[page] : HashBytes(pages[page]->bytes, PAGE_SIZE);
+            hash = (hash ^ pageHash) * 0x9E3779B97F4A7C15u;
+        }
+        hash = HashBytes(video, sizeof(video), hash);
+#endif
+
+        uint8_t scalars[] = {
+            uint8_t(index), uint8_t(index >> 8u), uint8_t(pc), uint8_t(pc >> 8u), delayTimer, soundTimer, sp
+        };
+        hash = HashBytes(registers, sizeof(registers), hash);
+        hash = HashBytes(scalars, sizeof(scalars), hash);
+        hash = HashBytes(stack, sizeof(stack), hash);
+        // a halted machine runs on differently from a running one in the same state
+        return stopped ? HashMix(hash ^ 0x5u) : hash;
+    }
+
+    uint64_t Chip8::CycleHash() const {
+        return HashBytes(rng.state, sizeof(rng.state), ContentHash());
+    }
+
+    std::vector<uint8_t> Chip8::SaveState() const {
+        std::vector<uint8_t> blob;
+        blob.reserve(512);
+        BlobWriter out{blob};
+
+        out.Bytes(SAVESTATE_MAGIC, sizeof(SAVESTATE_MAGIC));
+        out.U8(SAVESTATE_VERSION);
+        out.U64(rom->hash);
+
+        out.Bytes(registers, sizeof(registers));
+        out.U16(index);
+        out.U16(pc);
+        out.U8(delayTimer);
+        out.U8(soundTimer);
+        for(unsigned int i = 0; i < STACK_LEVELS; ++i) {
+            out.U16(stack[i]);
+        }
+        out.U8(sp);
+
+        // rows go out leftmost pixel first
+        for(unsigned int row = 0; row < VIDEO_HEIGHT; ++row) {
+            for(int shift = VIDEO_WIDTH - 8; shift >= 0; shift -= 8) {
+                out.U8(video[row] >> shift);
+            }
+        }
+
+        // memory delta, count is patched in once the runs are known
+        size_t countPos = blob.size();
+        out.U16(0);
+        uint16_t runCount = 0;
+
+        unsigned int address = 0;
+        while(address < MEMORY_SIZE) {
+            if(pages[address / PAGE_SIZE] == rom->pages[address / PAGE_SIZE]) {
+                // never written, skip the whole page
+                address = (address / PAGE_SIZE + 1) * PAGE_SIZE;
+                continue;
+            }
+            if(Read(address) == rom->Read(address)) {
+                ++address;
+                continue;
+            }
+
+            // extend the run until RUN_MERGE_GAP matching bytes in a row are found
+            unsigned int start = address;
+            unsigned int end = address + 1;
+            for(unsigned int i = end; i < MEMORY_SIZE && i - end < RUN_MERGE_GAP; ++i) {
+                if(Read(i) != rom->Read(i)) {
+                    end = i + 1;
+                }
+            }
+
+            out.U16(start);
+            out.U16(end - start);
+            for(unsigned int i = start; i < end; ++i) {
+                out.U8(Read(i));
+            }
+            ++runCount;
+
+            address = end;
+        }
+
+        blob[countPos] = runCount & 0xFFu;
+        blob[countPos + 1] = runCount >> 8u;
+
+        for(unsigned int i = 0; i < 4; ++i) {
+            out.U32(rng.state[i]);
+        }
+        out.U8(stopped);
+        out.U8(uint8_t(fault));
+
+        return blob;
+    }
+
+    bool Chip8::LoadState(std::span<const uint8_t> blob) {
+        BlobReader in{blob};
+
+        uint8_t magic[sizeof(SAVESTATE_MAGIC)]{};
+        in.Bytes(magic, sizeof(magic));
+        if(!in.ok || memcmp(magic, SAVESTATE_MAGIC, sizeof(magic)) != 0) {
+            return false;
+        }
+        uint8_t version = in.U8();
+        if(version < 1 || version > SAVESTATE_VERSION || in.U64() != rom->hash) {
+            return false;
+        }
+
+        // decode into a snapshot first so a truncated blob can't leave the machine half loaded
+        Snapshot snapshot;
+        for(unsigned int page = 0; page < PAGE_COUNT; ++page) {
+            memcpy(&snapshot.memory[page * PAGE_SIZE], rom->pages[page]->bytes, PAGE_SIZE);
+        }
+
+        in.Bytes(snapshot.registers, sizeof(snapshot.registers));
+        snapshot.index = in.U16();
+        snapshot.pc = in.U16();
+        snapshot.delayTimer = in.U8();
+        snapshot.soundTimer = in.U8();
+        for(unsigned int i = 0; i < STACK_LEVELS; ++i) {
+            snapshot.stack[i] = in.U16();
+        }
+        snapshot.sp = in.U8();
+        for(unsigned int row = 0; row < VIDEO_HEIGHT; ++row) {
+            snapshot.video[row] = 0;
+            for(unsigned int byte = 0; byte < VIDEO_WIDTH / 8; ++byte) {
+                snapshot.video[row] = (snapshot.video[row] << 8u) | in.U8();
+            }
+        }
+
+        uint16_t runCount = in.U16();
+        for(uint16_t run = 0; run < runCount && in.ok; ++run) {
+            uint16_t start = in.U16();
+            uint16_t length = in.U16();
+            if(start + length > MEMORY_SIZE) {
+                return false;
+            }
+            in.Bytes(&snapshot.memory[start], length);
+        }
+
+        if(version == 1) {
+            // the old engine's state can't be carried over, keep the current generator
+            std::string rngText(in.U8(), '\0');
+            in.Bytes(rngText.data(), rngText.size());
+            snapshot.rng = rng;
+        } else {
+            for(unsigned int i = 0; i < 4; ++i) {
+                snapshot.rng.state[i] = in.U32();
+            }
+        }
+
+        // states from before faults were saved never halted on one
+        snapshot.stopped = false;
+        snapshot.fault = Fault::None;
+        if(version >= 3) {
+            snapshot.stopped = in.U8() != 0;
+            uint8_t kind = in.U8();
+            if(kind >= FAULT_KINDS) {
+                return false;
+            }
+            snapshot.fault = Fault(kind);
+        }
+
+        // sp past the stack is a state a faulting ROM gets into, it wraps like the machine does
+        if(!in.ok) {
+            return false;
+        }
+
+        Restore(snapshot);
+        return true;
+    }
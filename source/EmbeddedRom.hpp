@@ -0,0 +1,12 @@
+#pragma once
+#include <cstdint>
+#include "Chip8.hpp"
+
+// ROM image baked into the binary at build time, see EMBED_ROM in the Makefile.
+// EmbeddedRom.inc is generated from the ROM file as a list of comma separated bytes.
+constexpr uint8_t embeddedRom[] =
+{
+#include "EmbeddedRom.inc"
+};
+
+static_assert(sizeof(embeddedRom) <= ROM_SIZE_MAX, "embedded ROM does not fit in chip-8 memory");
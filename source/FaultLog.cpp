@@ -0,0 +1,121 @@
+#include "FaultLog.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+
+FaultLog& FaultLog::Instance()
+{
+	static FaultLog log;
+	return log;
+}
+
+FaultLog::FaultLog()
+{
+	for (size_t i = 0; i < FAULT_LOG_SLOTS; ++i)
+	{
+		slots[i].sequence.store(i, std::memory_order_relaxed);
+	}
+}
+
+FaultLog::~FaultLog()
+{
+	Drain(std::cerr);
+}
+
+bool FaultLog::Admit()
+{
+	uint64_t second = std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+	uint64_t limit = std::min<uint64_t>(rateLimit.load(std::memory_order_relaxed), (1u << 24) - 1);
+	uint64_t current = window.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		uint64_t next;
+		if (current >> 24 != second)
+		{
+			next = second << 24 | 1;
+		}
+		else if ((current & 0xFFFFFFu) < limit)
+		{
+			next = current + 1;
+		}
+		else
+		{
+			return false;
+		}
+		if (window.compare_exchange_weak(current, next, std::memory_order_relaxed))
+		{
+			return limit > 0;
+		}
+	}
+}
+
+void FaultLog::Record(Chip8::Fault fault, uint16_t pc, uint16_t opcode)
+{
+	recorded.fetch_add(1, std::memory_order_relaxed);
+	if (!Admit())
+	{
+		dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	uint64_t ticket = tail.load(std::memory_order_relaxed);
+	for (;;)
+	{
+		Slot& slot = slots[ticket % FAULT_LOG_SLOTS];
+		int64_t turn = int64_t(slot.sequence.load(std::memory_order_acquire) - ticket);
+		if (turn == 0)
+		{
+			if (tail.compare_exchange_weak(ticket, ticket + 1, std::memory_order_relaxed))
+			{
+				slot.entry = {fault, pc, opcode};
+				slot.sequence.store(ticket + 1, std::memory_order_release);
+				return;
+			}
+		}
+		else if (turn < 0)
+		{
+			// a lap ahead of the reader, nobody drained in time
+			dropped.fetch_add(1, std::memory_order_relaxed);
+			return;
+		}
+		else
+		{
+			ticket = tail.load(std::memory_order_relaxed);
+		}
+	}
+}
+
+size_t FaultLog::Drain(std::ostream& out)
+{
+	std::lock_guard<std::mutex> lock(draining);
+	size_t printed = 0;
+	for (;; ++head, ++printed)
+	{
+		Slot& slot = slots[head % FAULT_LOG_SLOTS];
+		if (slot.sequence.load(std::memory_order_acquire) != head + 1)
+		{
+			break;
+		}
+		Entry entry = slot.entry;
+		slot.sequence.store(head + FAULT_LOG_SLOTS, std::memory_order_release);
+
+		out << "Fault: " << Chip8::FaultName(entry.fault) << " at 0x" << std::hex << std::setfill('0')
+			<< std::setw(3) << entry.pc << ", opcode " << std::setw(4) << entry.opcode << std::dec << "\n";
+	}
+
+	uint64_t droppedNow = dropped.load(std::memory_order_relaxed);
+	if (droppedNow != droppedReported)
+	{
+		out << "Fault: " << droppedNow - droppedReported << " more not logged\n";
+		droppedReported = droppedNow;
+	}
+	return printed;
+}
+
+FaultLog::Stats FaultLog::GetStats() const
+{
+	uint64_t all = recorded.load(std::memory_order_relaxed);
+	uint64_t lost = dropped.load(std::memory_order_relaxed);
+	return {all, all - lost, lost};
+}
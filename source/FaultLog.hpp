@@ -0,0 +1,69 @@
+#pragma once
+#include "Chip8.hpp"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+
+// slots in the log's ring, records beyond that wait for a Drain or are dropped
+const size_t FAULT_LOG_SLOTS = 256;
+
+// Process-wide sink for the faults machines raise. Record never blocks and never does I/O: it
+// claims a slot in a fixed ring with a compare-and-swap and returns, and drops the record (counting
+// it) once more than the rate limit arrived this second or the ring is full. Whoever owns the
+// console calls Drain every now and then to print what was kept; whatever is left is printed to
+// stderr at exit. A ROM stuck on bad data so costs a few atomics per fault instead of a flushed
+// console write.
+class FaultLog
+{
+public:
+    struct Stats {
+        // everything recorded, what made it into the ring, and what was dropped
+        uint64_t recorded;
+        uint64_t logged;
+        uint64_t dropped;
+    };
+
+    static FaultLog& Instance();
+
+    // from any thread, pc is where the faulting instruction is
+    void Record(Chip8::Fault fault, uint16_t pc, uint16_t opcode);
+    // records kept per second at most, the rest are only counted
+    void SetRateLimit(uint32_t perSecond) { rateLimit.store(perSecond, std::memory_order_relaxed); }
+
+    // prints the records in the ring, a line each, and how many were dropped since the last drain;
+    // returns the number of records printed
+    size_t Drain(std::ostream& out);
+    Stats GetStats() const;
+
+private:
+    FaultLog();
+    ~FaultLog();
+
+    struct Entry {
+        Chip8::Fault fault;
+        uint16_t pc;
+        uint16_t opcode;
+    };
+    // the sequence number says whose turn the slot is: the writer of ticket n waits for n, the
+    // reader of ticket n for n + 1
+    struct Slot {
+        std::atomic<uint64_t> sequence;
+        Entry entry;
+    };
+
+    bool Admit();
+
+    Slot slots[FAULT_LOG_SLOTS];
+    alignas(64) std::atomic<uint64_t> tail{};
+    alignas(64) uint64_t head{};
+    std::mutex draining;
+
+    // second the current count belongs to in the upper bits, records kept in it in the lower 24
+    std::atomic<uint64_t> window{};
+    std::atomic<uint32_t> rateLimit{100};
+
+    std::atomic<uint64_t> recorded{};
+    std::atomic<uint64_t> dropped{};
+    uint64_t droppedReported{};
+};
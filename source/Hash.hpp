@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// FNV-1a, byte at a time; used for ROM identity where speed doesn't matter
+inline uint64_t HashFnv1a(void const* data, size_t size) {
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    uint64_t hash = 0xCBF29CE484222325u;
+    for(size_t i = 0; i < size; ++i) {
+        hash = (hash ^ bytes[i]) * 0x100000001B3u;
+    }
+    return hash;
+}
+
+inline uint64_t HashMix(uint64_t x) {
+    // murmur3 finalizer
+    x ^= x >> 33u;
+    x *= 0xFF51AFD7ED558CCDu;
+    x ^= x >> 33u;
+    x *= 0xC4CEB9FE1A85EC53u;
+    x ^= x >> 33u;
+    return x;
+}
+
+// Zobrist-style key for a value in a slot (a memory address, a screen row...), a hash of a whole
+// state is the XOR of the keys of all its slots and follows a change by XORing out the old key and
+// XORing in the new one
+inline uint64_t ZobristKey(uint64_t slot, uint64_t value) {
+    return HashMix(HashMix(slot + 0x9E3779B97F4A7C15u) ^ value);
+}
+
+// eight bytes per step, for hashing machine state every frame
+inline uint64_t HashBytes(void const* data, size_t size, uint64_t seed = 0) {
+    uint8_t const* bytes = static_cast<uint8_t const*>(data);
+    uint64_t hash = seed ^ (size * 0x9E3779B97F4A7C15u);
+
+    size_t i = 0;
+    for(; i + 8 <= size; i += 8) {
+        uint64_t word;
+        memcpy(&word, &bytes[i], 8);
+        hash = (hash ^ HashMix(word)) * 0x9E3779B97F4A7C15u;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, &bytes[i], size - i);
+
+    return HashMix(hash ^ tail);
+}
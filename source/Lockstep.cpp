@@ -0,0 +1,588 @@
+#include "Lockstep.hpp"
+#include <array>
+#include <bit>
+#include <cstring>
+
+// Sets row[lane] = value(lane) in every lane of the group. The select is unconditional so the
+// loop has no branches and vectorizes.
+template <typename T, typename F>
+static inline void Masked(T* row, uint8_t const* on, unsigned int lanes, F value)
+{
+	for (unsigned int lane = 0; lane < lanes; ++lane)
+	{
+		T result = value(lane);
+		row[lane] = on[lane] ? result : row[lane];
+	}
+}
+
+// open addressing table for grouping lanes by opcode, twice the lane count keeps probes short
+const unsigned int GROUP_SLOTS = 2 * LOCKSTEP_LANES_MAX;
+
+// LANE_BYTES[m] has byte i set to 1 where bit i of m is set
+static const auto LANE_BYTES = []
+{
+	std::array<uint64_t, 256> table{};
+	for (unsigned int mask = 0; mask < 256; ++mask)
+	{
+		for (unsigned int bit = 0; bit < 8; ++bit)
+		{
+			uint8_t on = (mask >> bit) & 1u;
+			memcpy(reinterpret_cast<uint8_t*>(&table[mask]) + bit, &on, 1);
+		}
+	}
+	return table;
+}();
+
+Lockstep::Lockstep(unsigned int lanes)
+	: lanes(lanes < LOCKSTEP_LANES_MAX ? lanes : LOCKSTEP_LANES_MAX),
+	  memory(this->lanes * MEMORY_SIZE)
+{
+	allLanes = this->lanes == 32 ? 0xFFFFFFFFu : (1u << this->lanes) - 1u;
+}
+
+void Lockstep::Load(unsigned int lane, Chip8 const& chip8)
+{
+	Chip8::Snapshot snapshot;
+	chip8.Capture(snapshot);
+
+	memcpy(Memory(lane), snapshot.memory, MEMORY_SIZE);
+	for (unsigned int i = 0; i < REGISTER_COUNT; ++i)
+	{
+		registers[i][lane] = snapshot.registers[i];
+	}
+	index[lane] = snapshot.index;
+	pc[lane] = snapshot.pc;
+	delayTimer[lane] = snapshot.delayTimer;
+	soundTimer[lane] = snapshot.soundTimer;
+	for (unsigned int i = 0; i < STACK_LEVELS; ++i)
+	{
+		stack[i][lane] = snapshot.stack[i];
+	}
+	sp[lane] = snapshot.sp;
+	memcpy(video[lane], snapshot.video, sizeof(snapshot.video));
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		rng[i][lane] = snapshot.rng.state[i];
+	}
+	keys[lane] = chip8.KeyMask();
+}
+
+void Lockstep::Store(unsigned int lane, Chip8& chip8) const
+{
+	Chip8::Snapshot snapshot;
+
+	memcpy(snapshot.memory, &memory[lane * MEMORY_SIZE], MEMORY_SIZE);
+	for (unsigned int i = 0; i < REGISTER_COUNT; ++i)
+	{
+		snapshot.registers[i] = registers[i][lane];
+	}
+	snapshot.index = index[lane];
+	snapshot.pc = pc[lane];
+	snapshot.delayTimer = delayTimer[lane];
+	snapshot.soundTimer = soundTimer[lane];
+	for (unsigned int i = 0; i < STACK_LEVELS; ++i)
+	{
+		snapshot.stack[i] = stack[i][lane];
+	}
+	snapshot.sp = sp[lane];
+	memcpy(snapshot.video, video[lane], sizeof(snapshot.video));
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		snapshot.rng.state[i] = rng[i][lane];
+	}
+	// lanes don't fault
+	snapshot.stopped = false;
+	snapshot.fault = Chip8::Fault::None;
+
+	chip8.Restore(snapshot);
+	chip8.SetKeys(keys[lane]);
+}
+
+void Lockstep::Remove(unsigned int lane)
+{
+	unsigned int last = lanes - 1;
+	memcpy(Memory(lane), Memory(last), MEMORY_SIZE);
+	for (unsigned int i = 0; i < REGISTER_COUNT; ++i)
+	{
+		registers[i][lane] = registers[i][last];
+	}
+	index[lane] = index[last];
+	pc[lane] = pc[last];
+	delayTimer[lane] = delayTimer[last];
+	soundTimer[lane] = soundTimer[last];
+	for (unsigned int i = 0; i < STACK_LEVELS; ++i)
+	{
+		stack[i][lane] = stack[i][last];
+	}
+	sp[lane] = sp[last];
+	memcpy(video[lane], video[last], sizeof(video[lane]));
+	for (unsigned int i = 0; i < 4; ++i)
+	{
+		rng[i][lane] = rng[i][last];
+	}
+	keys[lane] = keys[last];
+	strays[lane] = strays[last];
+
+	lanes = last;
+	allLanes = lanes == 32 ? 0xFFFFFFFFu : (1u << lanes) - 1u;
+}
+
+void Lockstep::RunFrame(unsigned int cycles)
+{
+	for (unsigned int i = 0; i < cycles; ++i)
+	{
+		Cycle();
+	}
+}
+
+void Lockstep::Cycle()
+{
+	for (unsigned int lane = 0; lane < lanes; ++lane)
+	{
+		uint8_t const* bytes = &memory[lane * MEMORY_SIZE];
+		opcodes[lane] = bytes[pc[lane] % MEMORY_SIZE] << 8u | bytes[(pc[lane] + 1u) % MEMORY_SIZE];
+	}
+	for (unsigned int lane = 0; lane < lanes; ++lane)
+	{
+		pc[lane] += 2;
+	}
+
+	// usually every lane fetched the same opcode and it runs once across all of them
+	bool converged = true;
+	for (unsigned int lane = 0; lane < lanes; ++lane)
+	{
+		converged &= opcodes[lane] == opcodes[0];
+	}
+	if (converged)
+	{
+		Run(opcodes[0], allLanes);
+	}
+	else
+	{
+		// otherwise lanes are grouped by opcode in a small hash table, which costs the same
+		// however many different opcodes there are
+		uint16_t slotOpcode[GROUP_SLOTS];
+		uint32_t slotLanes[GROUP_SLOTS]{};
+		uint8_t used[LOCKSTEP_LANES_MAX];
+		unsigned int groups = 0;
+
+		for (unsigned int lane = 0; lane < lanes; ++lane)
+		{
+			uint16_t opcode = opcodes[lane];
+			unsigned int slot = (opcode * 0x9E37u >> 8u) % GROUP_SLOTS;
+			while (slotLanes[slot] && slotOpcode[slot] != opcode)
+			{
+				slot = (slot + 1) % GROUP_SLOTS;
+			}
+			if (!slotLanes[slot])
+			{
+				slotOpcode[slot] = opcode;
+				used[groups++] = slot;
+			}
+			slotLanes[slot] |= 1u << lane;
+		}
+		for (unsigned int i = 0; i < groups; ++i)
+		{
+			uint32_t group = slotLanes[used[i]];
+			unsigned int count = std::popcount(group);
+			if (count < 2 || count * LOCKSTEP_STRAY_SHARE < lanes)
+			{
+				for (uint32_t stray = group; stray; stray &= stray - 1)
+				{
+					++strays[std::countr_zero(stray)];
+				}
+			}
+			Run(slotOpcode[used[i]], group);
+		}
+	}
+
+	for (unsigned int lane = 0; lane < lanes; ++lane)
+	{
+		delayTimer[lane] -= delayTimer[lane] > 0;
+		soundTimer[lane] -= soundTimer[lane] > 0;
+	}
+}
+
+void Lockstep::Run(uint16_t opcode, uint32_t group)
+{
+	unsigned int count = std::popcount(group);
+	if (count > 1 && Vectorizable(opcode))
+	{
+		Vector(opcode, group);
+		vectorSteps += count;
+		return;
+	}
+	for (; group; group &= group - 1)
+	{
+		Scalar(std::countr_zero(group), opcode);
+	}
+	scalarSteps += count;
+}
+
+bool Lockstep::Vectorizable(uint16_t opcode)
+{
+	// calls, returns, draws and memory access index per lane, everything else runs across lanes
+	switch (opcode >> 12u)
+	{
+	case 0x0:
+	case 0x2:
+	case 0xD:
+		return false;
+	case 0x8:
+		return (opcode & 0x000Fu) <= 0x7u || (opcode & 0x000Fu) == 0xEu;
+	case 0xE:
+		// decoded on the low nibble like Chip8's tableE, so E19E and E1AE are the same skip
+		return (opcode & 0x000Fu) == 0xEu || (opcode & 0x000Fu) == 0x1u;
+	case 0xF:
+		switch (opcode & 0x00FFu)
+		{
+		case 0x07:
+		case 0x15:
+		case 0x18:
+		case 0x1E:
+		case 0x29:
+			return true;
+		}
+		return false;
+	}
+	return true;
+}
+
+void Lockstep::Vector(uint16_t opcode, uint32_t group)
+{
+	// one byte per lane, spread from the group mask eight lanes at a time
+	uint8_t on[LOCKSTEP_LANES_MAX];
+	for (unsigned int i = 0; i < LOCKSTEP_LANES_MAX / 8; ++i)
+	{
+		memcpy(&on[8 * i], &LANE_BYTES[(group >> (8 * i)) & 0xFFu], 8);
+	}
+
+	unsigned int x = (opcode & 0x0F00u) >> 8u;
+	unsigned int y = (opcode & 0x00F0u) >> 4u;
+	uint8_t byte = opcode & 0x00FFu;
+	uint16_t address = opcode & 0x0FFFu;
+	uint8_t* vx = registers[x];
+	uint8_t* vy = registers[y];
+	uint8_t* vf = registers[0xF];
+
+	// flag writes come before the result like in Chip8, which matters when x or y is F
+	switch (opcode >> 12u)
+	{
+	case 0x1:
+		Masked(pc, on, lanes, [&](unsigned int) { return address; });
+		return;
+	case 0x3:
+		Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(pc[l] + (vx[l] == byte ? 2 : 0)); });
+		return;
+	case 0x4:
+		Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(pc[l] + (vx[l] != byte ? 2 : 0)); });
+		return;
+	case 0x5:
+		Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(pc[l] + (vx[l] == vy[l] ? 2 : 0)); });
+		return;
+	case 0x6:
+		Masked(vx, on, lanes, [&](unsigned int) { return byte; });
+		return;
+	case 0x7:
+		Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] + byte); });
+		return;
+	case 0x8:
+		switch (opcode & 0x000Fu)
+		{
+		case 0x0:
+			Masked(vx, on, lanes, [&](unsigned int l) { return vy[l]; });
+			return;
+		case 0x1:
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] | vy[l]); });
+			return;
+		case 0x2:
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] & vy[l]); });
+			return;
+		case 0x3:
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] ^ vy[l]); });
+			return;
+		case 0x4:
+		{
+			uint8_t sum[LOCKSTEP_LANES_MAX];
+			for (unsigned int l = 0; l < lanes; ++l)
+			{
+				sum[l] = vx[l] + vy[l];
+			}
+			Masked(vf, on, lanes, [&](unsigned int l) { return uint8_t(sum[l] < vx[l]); });
+			Masked(vx, on, lanes, [&](unsigned int l) { return sum[l]; });
+			return;
+		}
+		case 0x5:
+			Masked(vf, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] > vy[l]); });
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] - vy[l]); });
+			return;
+		case 0x6:
+			Masked(vf, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] & 1u); });
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] >> 1u); });
+			return;
+		case 0x7:
+			Masked(vf, on, lanes, [&](unsigned int l) { return uint8_t(vy[l] > vx[l]); });
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vy[l] - vx[l]); });
+			return;
+		case 0xE:
+			Masked(vf, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] >> 7u); });
+			Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(vx[l] << 1u); });
+			return;
+		}
+		break;
+	case 0x9:
+		Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(pc[l] + (vx[l] != vy[l] ? 2 : 0)); });
+		return;
+	case 0xA:
+		Masked(index, on, lanes, [&](unsigned int) { return address; });
+		return;
+	case 0xB:
+		Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(address + registers[0][l]); });
+		return;
+	case 0xC:
+	{
+		// xoshiro128** on every lane's own state, same sequence as Rng::Next
+		uint8_t random[LOCKSTEP_LANES_MAX];
+		for (unsigned int l = 0; l < lanes; ++l)
+		{
+			uint32_t s0 = rng[0][l], s1 = rng[1][l], s2 = rng[2][l], s3 = rng[3][l];
+			uint32_t result = Rng::Rotl(s1 * 5u, 7) * 9u;
+			uint32_t t = s1 << 9u;
+			s2 ^= s0;
+			s3 ^= s1;
+			s1 ^= s2;
+			s0 ^= s3;
+			s2 ^= t;
+			s3 = Rng::Rotl(s3, 11);
+			random[l] = result >> 24u;
+
+			rng[0][l] = on[l] ? s0 : rng[0][l];
+			rng[1][l] = on[l] ? s1 : rng[1][l];
+			rng[2][l] = on[l] ? s2 : rng[2][l];
+			rng[3][l] = on[l] ? s3 : rng[3][l];
+		}
+		Masked(vx, on, lanes, [&](unsigned int l) { return uint8_t(random[l] & byte); });
+		return;
+	}
+	case 0xE:
+		if ((opcode & 0x000Fu) == 0xE)
+		{
+			Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(pc[l] + ((keys[l] >> (vx[l] & 0xFu)) & 1u) * 2); });
+			return;
+		}
+		if ((opcode & 0x000Fu) == 0x1)
+		{
+			Masked(pc, on, lanes, [&](unsigned int l) { return uint16_t(pc[l] + (~(keys[l] >> (vx[l] & 0xFu)) & 1u) * 2); });
+			return;
+		}
+		break;
+	case 0xF:
+		switch (byte)
+		{
+		case 0x07:
+			Masked(vx, on, lanes, [&](unsigned int l) { return delayTimer[l]; });
+			return;
+		case 0x15:
+			Masked(delayTimer, on, lanes, [&](unsigned int l) { return vx[l]; });
+			return;
+		case 0x18:
+			Masked(soundTimer, on, lanes, [&](unsigned int l) { return vx[l]; });
+			return;
+		case 0x1E:
+			Masked(index, on, lanes, [&](unsigned int l) { return uint16_t(index[l] + vx[l]); });
+			return;
+		case 0x29:
+			Masked(index, on, lanes, [&](unsigned int l) { return uint16_t(FONTSET_START_ADDRESS + 5 * vx[l]); });
+			return;
+		}
+		break;
+	}
+}
+
+void Lockstep::Scalar(unsigned int lane, uint16_t opcode)
+{
+	unsigned int x = (opcode & 0x0F00u) >> 8u;
+	unsigned int y = (opcode & 0x00F0u) >> 4u;
+	uint8_t byte = opcode & 0x00FFu;
+	uint16_t address = opcode & 0x0FFFu;
+	uint8_t& vx = registers[x][lane];
+	uint8_t& vy = registers[y][lane];
+	uint8_t& vf = registers[0xF][lane];
+	uint8_t* bytes = Memory(lane);
+
+	switch (opcode >> 12u)
+	{
+	case 0x0:
+		// the low nibble picks the instruction, as in Chip8's table0: 0x0000 clears the screen too
+		if ((opcode & 0x000Fu) == 0x0)
+		{
+			memset(video[lane], 0, sizeof(video[lane]));
+		}
+		else if ((opcode & 0x000Fu) == 0xE)
+		{
+			--sp[lane];
+			pc[lane] = stack[sp[lane] % STACK_LEVELS][lane];
+		}
+		break;
+	case 0x1:
+		pc[lane] = address;
+		break;
+	case 0x2:
+		stack[sp[lane] % STACK_LEVELS][lane] = pc[lane];
+		++sp[lane];
+		pc[lane] = address;
+		break;
+	case 0x3:
+		pc[lane] += vx == byte ? 2 : 0;
+		break;
+	case 0x4:
+		pc[lane] += vx != byte ? 2 : 0;
+		break;
+	case 0x5:
+		pc[lane] += vx == vy ? 2 : 0;
+		break;
+	case 0x6:
+		vx = byte;
+		break;
+	case 0x7:
+		vx += byte;
+		break;
+	case 0x8:
+		switch (opcode & 0x000Fu)
+		{
+		case 0x0: vx = vy; break;
+		case 0x1: vx |= vy; break;
+		case 0x2: vx &= vy; break;
+		case 0x3: vx ^= vy; break;
+		case 0x4:
+		{
+			uint16_t sum = vx + vy;
+			vf = sum > 255u;
+			vx = sum & 0xFFu;
+			break;
+		}
+		case 0x5:
+			vf = vx > vy;
+			vx = vx - vy;
+			break;
+		case 0x6:
+			vf = vx & 1u;
+			vx >>= 1u;
+			break;
+		case 0x7:
+			vf = vy > vx;
+			vx = vy - vx;
+			break;
+		case 0xE:
+			vf = vx >> 7u;
+			vx <<= 1u;
+			break;
+		}
+		break;
+	case 0x9:
+		pc[lane] += vx != vy ? 2 : 0;
+		break;
+	case 0xA:
+		index[lane] = address;
+		break;
+	case 0xB:
+		pc[lane] = address + registers[0][lane];
+		break;
+	case 0xC:
+	{
+		Rng laneRng;
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			laneRng.state[i] = rng[i][lane];
+		}
+		vx = (laneRng.Next() >> 24u) & byte;
+		for (unsigned int i = 0; i < 4; ++i)
+		{
+			rng[i][lane] = laneRng.state[i];
+		}
+		break;
+	}
+	case 0xD:
+	{
+		// same row-at-a-time drawing as Chip8::OP_Dxyn
+		unsigned int xPos = vx % VIDEO_WIDTH;
+		unsigned int yPos = vy % VIDEO_HEIGHT;
+		unsigned int height = opcode & 0x000Fu;
+		vf = 0;
+		for (unsigned int row = 0; row < height && yPos + row < VIDEO_HEIGHT; ++row)
+		{
+			uint64_t spriteRow = (uint64_t(bytes[(index[lane] + row) % MEMORY_SIZE]) << (VIDEO_WIDTH - 8)) >> xPos;
+			uint64_t& screenRow = video[lane][yPos + row];
+			if (screenRow & spriteRow)
+			{
+				vf = 1;
+			}
+			screenRow ^= spriteRow;
+		}
+		break;
+	}
+	case 0xE:
+		if ((opcode & 0x000Fu) == 0xE)
+		{
+			pc[lane] += (keys[lane] >> (vx & 0xFu)) & 1u ? 2 : 0;
+		}
+		else if ((opcode & 0x000Fu) == 0x1)
+		{
+			pc[lane] += (keys[lane] >> (vx & 0xFu)) & 1u ? 0 : 2;
+		}
+		break;
+	case 0xF:
+		switch (byte)
+		{
+		case 0x07:
+			vx = delayTimer[lane];
+			break;
+		case 0x0A:
+			// lowest held key, or wait on this instruction
+			if (keys[lane])
+			{
+				vx = std::countr_zero(keys[lane]);
+			}
+			else
+			{
+				pc[lane] -= 2;
+			}
+			break;
+		case 0x15:
+			delayTimer[lane] = vx;
+			break;
+		case 0x18:
+			soundTimer[lane] = vx;
+			break;
+		case 0x1E:
+			index[lane] += vx;
+			break;
+		case 0x29:
+			index[lane] = FONTSET_START_ADDRESS + 5 * vx;
+			break;
+		case 0x33:
+		{
+			uint8_t number = vx;
+			bytes[(index[lane] + 2) % MEMORY_SIZE] = number % 10;
+			number /= 10;
+			bytes[(index[lane] + 1) % MEMORY_SIZE] = number % 10;
+			number /= 10;
+			bytes[index[lane] % MEMORY_SIZE] = number % 10;
+			break;
+		}
+		case 0x55:
+			for (unsigned int i = 0; i <= x; ++i)
+			{
+				bytes[(index[lane] + i) % MEMORY_SIZE] = registers[i][lane];
+			}
+			break;
+		case 0x65:
+			for (unsigned int i = 0; i <= x; ++i)
+			{
+				registers[i][lane] = bytes[(index[lane] + i) % MEMORY_SIZE];
+			}
+			break;
+		}
+		break;
+	}
+}
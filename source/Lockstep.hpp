@@ -0,0 +1,76 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+const unsigned int LOCKSTEP_LANES_MAX = 32;
+// a lane in a group smaller than this share of all lanes is straying from the rest
+const unsigned int LOCKSTEP_STRAY_SHARE = 4;
+
+// Runs up to 32 machines side by side, typically the same ROM with different seeds or keys.
+// State is stored lane-major (registers[x][lane] and so on) so that when lanes fetch the same
+// opcode, it runs as one loop over every lane that the compiler turns into vector instructions,
+// with a lane mask selecting which lanes keep the result. Lanes that fetched something else are
+// grouped by opcode the same way, and lone lanes, memory writes, calls and draws run one lane at
+// a time. Every lane ends up in exactly the state a Chip8 running the same inputs would.
+// Once lanes have split up this costs more than running them one by one, which is what Strays
+// is for: a lane that keeps straying is better off taken out with Remove and run on a Chip8.
+class Lockstep
+{
+public:
+    explicit Lockstep(unsigned int lanes);
+
+    unsigned int Lanes() const { return lanes; }
+
+    // copies a machine into a lane and back, Store keeps pages still shared with chip8's ROM shared
+    void Load(unsigned int lane, Chip8 const& chip8);
+    void Store(unsigned int lane, Chip8& chip8) const;
+    // the last lane moves into the freed one
+    void Remove(unsigned int lane);
+
+    void SetKeys(unsigned int lane, uint16_t mask) { keys[lane] = mask; }
+    void Cycle();
+    void RunFrame(unsigned int cycles);
+
+    uint64_t const* Video(unsigned int lane) const { return video[lane]; }
+
+    // lane instructions run across lanes and one lane at a time
+    uint64_t VectorSteps() const { return vectorSteps; }
+    uint64_t ScalarSteps() const { return scalarSteps; }
+    // instructions the lane ran in a group of fewer than 1 in LOCKSTEP_STRAY_SHARE lanes (or alone)
+    // since ClearStrays
+    uint32_t Strays(unsigned int lane) const { return strays[lane]; }
+    void ClearStrays() { memset(strays, 0, sizeof(strays)); }
+
+private:
+    // runs one opcode on every lane in the group
+    void Run(uint16_t opcode, uint32_t group);
+    static bool Vectorizable(uint16_t opcode);
+    void Vector(uint16_t opcode, uint32_t group);
+    void Scalar(unsigned int lane, uint16_t opcode);
+
+    uint8_t* Memory(unsigned int lane) { return &memory[lane * MEMORY_SIZE]; }
+
+    unsigned int lanes;
+    uint32_t allLanes;
+
+    alignas(64) uint8_t registers[REGISTER_COUNT][LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint16_t pc[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint16_t index[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint8_t delayTimer[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint8_t soundTimer[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint8_t sp[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint16_t keys[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint16_t opcodes[LOCKSTEP_LANES_MAX]{};
+    alignas(64) uint32_t rng[4][LOCKSTEP_LANES_MAX]{};
+    uint32_t strays[LOCKSTEP_LANES_MAX]{};
+    uint16_t stack[STACK_LEVELS][LOCKSTEP_LANES_MAX]{};
+    uint64_t video[LOCKSTEP_LANES_MAX][VIDEO_HEIGHT]{};
+
+    // one 4 KB block per lane
+    std::vector<uint8_t> memory;
+
+    uint64_t vectorSteps{};
+    uint64_t scalarSteps{};
+};
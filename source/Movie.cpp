@@ -0,0 +1,472 @@
+#include "Movie.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+const uint8_t MOVIE_MAGIC[4] = { 'C', '8', 'M', 'V' };
+const uint8_t MOVIE_VERSION = 2;
+const uint8_t INDEX_MAGIC[4] = { 'C', '8', 'I', 'X' };
+
+const uint8_t RECORD_INPUT = 'I';
+const uint8_t RECORD_HASH = 'H';
+const uint8_t RECORD_KEYFRAME = 'K';
+const uint8_t RECORD_END = 'E';
+const uint8_t RECORD_INDEX = 'X';
+
+template <typename T>
+static void Put(std::ostream& out, T value)
+{
+	uint8_t bytes[sizeof(T)];
+	for (unsigned int i = 0; i < sizeof(T); ++i)
+	{
+		bytes[i] = uint8_t(value >> (8u * i));
+	}
+	out.write(reinterpret_cast<char const*>(bytes), sizeof(T));
+}
+
+template <typename T>
+static T Get(std::istream& in)
+{
+	uint8_t bytes[sizeof(T)]{};
+	in.read(reinterpret_cast<char*>(bytes), sizeof(T));
+
+	T value = 0;
+	for (unsigned int i = 0; i < sizeof(T); ++i)
+	{
+		value |= T(bytes[i]) << (8u * i);
+	}
+	return value;
+}
+
+bool Movie::Load(char const* path)
+{
+	std::ifstream file(path, std::ios::binary);
+	uint8_t magic[sizeof(MOVIE_MAGIC)]{};
+	file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+	uint8_t version = Get<uint8_t>(file);
+
+	if (!file || memcmp(magic, MOVIE_MAGIC, sizeof(magic)) != 0 || version < 1 || version > MOVIE_VERSION)
+	{
+		return false;
+	}
+
+	this->path = path;
+	romHash = Get<uint64_t>(file);
+	seed = Get<uint64_t>(file);
+	cyclesPerFrame = Get<uint32_t>(file);
+	hashInterval = Get<uint32_t>(file);
+	keyframeInterval = version >= 2 ? Get<uint32_t>(file) : 0;
+	inputs.clear();
+	checks.clear();
+	keyframes.clear();
+
+	uint32_t frame = 0;
+
+	while (file)
+	{
+		uint8_t tag = Get<uint8_t>(file);
+
+		if (tag == RECORD_INPUT)
+		{
+			uint16_t mask = Get<uint16_t>(file);
+			uint32_t length = Get<uint32_t>(file);
+			inputs.push_back({frame, mask});
+			frame += length;
+		}
+		else if (tag == RECORD_HASH)
+		{
+			uint32_t checkFrame = Get<uint32_t>(file);
+			uint64_t hash = Get<uint64_t>(file);
+			checks.push_back({checkFrame, hash});
+		}
+		else if (tag == RECORD_KEYFRAME)
+		{
+			// the index at the end lists these, only skip over the state here
+			file.seekg(12, std::ios::cur);
+			uint32_t size = Get<uint32_t>(file);
+			file.seekg(size, std::ios::cur);
+		}
+		else if (tag == RECORD_END)
+		{
+			frameCount = Get<uint32_t>(file);
+			break;
+		}
+		else
+		{
+			// truncated or corrupt, a movie is only usable once it has been finished
+			return false;
+		}
+	}
+
+	if (!file || frameCount != frame)
+	{
+		return false;
+	}
+	if (version < 2)
+	{
+		return true;
+	}
+
+	// find the keyframe index through the footer
+	file.seekg(-int(sizeof(uint64_t) + sizeof(INDEX_MAGIC)), std::ios::end);
+	uint64_t indexOffset = Get<uint64_t>(file);
+	file.read(reinterpret_cast<char*>(magic), sizeof(magic));
+	if (!file || memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0)
+	{
+		return false;
+	}
+
+	file.seekg(indexOffset);
+	if (Get<uint8_t>(file) != RECORD_INDEX)
+	{
+		return false;
+	}
+
+	uint32_t count = Get<uint32_t>(file);
+	for (uint32_t i = 0; i < count && file; ++i)
+	{
+		Keyframe keyframe{};
+		keyframe.frame = Get<uint32_t>(file);
+		keyframe.offset = Get<uint64_t>(file);
+		keyframes.push_back(keyframe);
+	}
+	for (Keyframe& keyframe : keyframes)
+	{
+		// the state hash is kept next to the state itself
+		file.seekg(keyframe.offset + 5);
+		keyframe.hash = Get<uint64_t>(file);
+	}
+
+	return bool(file);
+}
+
+uint16_t Movie::KeysAt(uint32_t frame) const
+{
+	auto run = std::upper_bound(inputs.begin(), inputs.end(), frame,
+		[](uint32_t frame, InputRun const& run) { return frame < run.start; });
+
+	return run == inputs.begin() ? 0 : (run - 1)->mask;
+}
+
+int Movie::KeyframeBefore(uint32_t frame) const
+{
+	auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), frame,
+		[](uint32_t frame, Keyframe const& keyframe) { return frame < keyframe.frame; });
+
+	return int(keyframe - keyframes.begin()) - 1;
+}
+
+bool Movie::ReadKeyframe(int keyframe, std::vector<uint8_t>& blob) const
+{
+	std::ifstream file(path, std::ios::binary);
+	file.seekg(keyframes[keyframe].offset + 13);
+
+	blob.resize(Get<uint32_t>(file));
+	file.read(reinterpret_cast<char*>(blob.data()), blob.size());
+
+	return bool(file);
+}
+
+MovieRecorder::MovieRecorder(char const* path, Chip8 const& chip8, uint64_t seed, unsigned int cyclesPerFrame,
+	unsigned int hashInterval, unsigned int keyframeInterval)
+	: file(path, std::ios::binary | std::ios::trunc),
+	  hashInterval(hashInterval),
+	  keyframeInterval(keyframeInterval)
+{
+	file.write(reinterpret_cast<char const*>(MOVIE_MAGIC), sizeof(MOVIE_MAGIC));
+	Put<uint8_t>(file, MOVIE_VERSION);
+	Put<uint64_t>(file, chip8.RomHash());
+	Put<uint64_t>(file, seed);
+	Put<uint32_t>(file, cyclesPerFrame);
+	Put<uint32_t>(file, hashInterval);
+	Put<uint32_t>(file, keyframeInterval);
+
+	// power-on state, so every frame has a keyframe at or before it
+	WriteKeyframe(chip8);
+}
+
+MovieRecorder::~MovieRecorder()
+{
+	FlushRun();
+	Put<uint8_t>(file, RECORD_END);
+	Put<uint32_t>(file, frame);
+
+	uint64_t indexOffset = file.tellp();
+	Put<uint8_t>(file, RECORD_INDEX);
+	Put<uint32_t>(file, keyframes.size());
+	for (Movie::Keyframe const& keyframe : keyframes)
+	{
+		Put<uint32_t>(file, keyframe.frame);
+		Put<uint64_t>(file, keyframe.offset);
+	}
+
+	Put<uint64_t>(file, indexOffset);
+	file.write(reinterpret_cast<char const*>(INDEX_MAGIC), sizeof(INDEX_MAGIC));
+}
+
+void MovieRecorder::Frame(uint16_t keys, Chip8 const& chip8)
+{
+	if (keys != runMask)
+	{
+		FlushRun();
+		runMask = keys;
+	}
+	++runLength;
+	++frame;
+
+	if (hashInterval && frame % hashInterval == 0)
+	{
+		// inputs up to this frame go out first so a reader sees them in order
+		FlushRun();
+		Put<uint8_t>(file, RECORD_HASH);
+		Put<uint32_t>(file, frame);
+		Put<uint64_t>(file, chip8.StateHash());
+	}
+
+	if (keyframeInterval && frame % keyframeInterval == 0)
+	{
+		FlushRun();
+		WriteKeyframe(chip8);
+	}
+}
+
+void MovieRecorder::WriteKeyframe(Chip8 const& chip8)
+{
+	std::vector<uint8_t> blob = chip8.SaveState();
+	uint64_t hash = chip8.StateHash();
+
+	keyframes.push_back({frame, hash, uint64_t(file.tellp())});
+	Put<uint8_t>(file, RECORD_KEYFRAME);
+	Put<uint32_t>(file, frame);
+	Put<uint64_t>(file, hash);
+	Put<uint32_t>(file, blob.size());
+	file.write(reinterpret_cast<char const*>(blob.data()), blob.size());
+}
+
+void MovieRecorder::FlushRun()
+{
+	if (runLength)
+	{
+		Put<uint8_t>(file, RECORD_INPUT);
+		Put<uint16_t>(file, runMask);
+		Put<uint32_t>(file, runLength);
+		runLength = 0;
+	}
+}
+
+PlaybackResult PlayMovie(Movie const& movie, Chip8& chip8)
+{
+	PlaybackResult result{};
+
+	if (chip8.RomHash() != movie.romHash)
+	{
+		// a different ROM diverges before the first frame
+		result.romMismatch = true;
+		result.expected = movie.romHash;
+		result.actual = chip8.RomHash();
+		return result;
+	}
+
+	chip8.Seed(movie.seed);
+
+	size_t nextCheck = 0;
+	for (size_t run = 0; run < movie.inputs.size(); ++run)
+	{
+		uint32_t end = run + 1 < movie.inputs.size() ? movie.inputs[run + 1].start : movie.frameCount;
+		chip8.SetKeys(movie.inputs[run].mask);
+
+		while (result.frames < end)
+		{
+			chip8.RunFrame(movie.cyclesPerFrame);
+			++result.frames;
+
+			if (nextCheck < movie.checks.size() && movie.checks[nextCheck].frame == result.frames)
+			{
+				uint64_t hash = chip8.StateHash();
+				if (hash != movie.checks[nextCheck].hash)
+				{
+					result.divergedFrame = result.frames;
+					result.expected = movie.checks[nextCheck].hash;
+					result.actual = hash;
+					return result;
+				}
+				++result.checks;
+				++nextCheck;
+			}
+		}
+	}
+
+	result.ok = true;
+	return result;
+}
+
+bool RerecordMovie(Movie const& movie, Chip8& chip8, char const* path, unsigned int hashInterval, unsigned int keyframeInterval)
+{
+	if (chip8.RomHash() != movie.romHash)
+	{
+		return false;
+	}
+
+	chip8.Seed(movie.seed);
+	MovieRecorder recorder(path, chip8, movie.seed, movie.cyclesPerFrame, hashInterval, keyframeInterval);
+	if (!recorder.IsOpen())
+	{
+		return false;
+	}
+
+	for (size_t run = 0; run < movie.inputs.size(); ++run)
+	{
+		uint32_t end = run + 1 < movie.inputs.size() ? movie.inputs[run + 1].start : movie.frameCount;
+		chip8.SetKeys(movie.inputs[run].mask);
+
+		for (uint32_t frame = movie.inputs[run].start; frame < end; ++frame)
+		{
+			chip8.RunFrame(movie.cyclesPerFrame);
+			recorder.Frame(movie.inputs[run].mask, chip8);
+		}
+	}
+
+	return true;
+}
+
+bool SeekMovie(Movie const& movie, Chip8& chip8, uint32_t frame)
+{
+	int keyframe = movie.KeyframeBefore(frame);
+	std::vector<uint8_t> blob;
+
+	if (frame > movie.frameCount || keyframe < 0 || !movie.ReadKeyframe(keyframe, blob) || !chip8.LoadState(blob))
+	{
+		return false;
+	}
+
+	for (uint32_t current = movie.keyframes[keyframe].frame; current < frame; ++current)
+	{
+		chip8.SetKeys(movie.KeysAt(current));
+		chip8.RunFrame(movie.cyclesPerFrame);
+	}
+
+	return true;
+}
+
+PlaybackResult VerifyMovie(Movie const& movie, Chip8 const& chip8, unsigned int threads)
+{
+	PlaybackResult result{};
+
+	if (chip8.RomHash() != movie.romHash || movie.keyframes.empty())
+	{
+		// no keyframes to split on, only a serial replay can check this one
+		Chip8 serial = chip8.Clone();
+		return PlayMovie(movie, serial);
+	}
+
+	std::atomic<size_t> nextSegment{0};
+	std::atomic<uint32_t> checksPassed{0};
+	std::mutex failureMutex;
+	bool failed = false;
+
+	auto worker = [&]()
+	{
+		Chip8 machine = chip8.Clone();
+		std::vector<uint8_t> blob;
+
+		for (size_t segment = nextSegment++; segment < movie.keyframes.size(); segment = nextSegment++)
+		{
+			uint32_t start = movie.keyframes[segment].frame;
+			bool last = segment + 1 == movie.keyframes.size();
+			uint32_t end = last ? movie.frameCount : movie.keyframes[segment + 1].frame;
+
+			{
+				// segments past an earlier failure can't change the result
+				std::lock_guard<std::mutex> lock(failureMutex);
+				if (failed && start >= result.divergedFrame)
+				{
+					continue;
+				}
+			}
+
+			// a failure in segment 0 can be on frame 0, so whether it failed is kept apart from where
+			bool segmentFailed = false;
+			uint32_t failedFrame = 0;
+			uint64_t expected = 0;
+			uint64_t actual = 0;
+			uint32_t checks = 0;
+
+			if (!movie.ReadKeyframe(segment, blob) || !machine.LoadState(blob) ||
+				machine.StateHash() != movie.keyframes[segment].hash)
+			{
+				// a damaged keyframe is reported where it was taken
+				segmentFailed = true;
+				failedFrame = start;
+				expected = movie.keyframes[segment].hash;
+				actual = machine.StateHash();
+			}
+			else
+			{
+				auto check = std::upper_bound(movie.checks.begin(), movie.checks.end(), start,
+					[](uint32_t frame, Movie::Check const& check) { return frame < check.frame; });
+
+				for (uint32_t frame = start; frame < end && !segmentFailed; ++frame)
+				{
+					machine.SetKeys(movie.KeysAt(frame));
+					machine.RunFrame(movie.cyclesPerFrame);
+
+					if (check != movie.checks.end() && check->frame == frame + 1)
+					{
+						uint64_t hash = machine.StateHash();
+						if (hash != check->hash)
+						{
+							segmentFailed = true;
+							failedFrame = frame + 1;
+							expected = check->hash;
+							actual = hash;
+						}
+						++check;
+						++checks;
+					}
+				}
+
+				if (!segmentFailed && !last && machine.StateHash() != movie.keyframes[segment + 1].hash)
+				{
+					segmentFailed = true;
+					failedFrame = end;
+					expected = movie.keyframes[segment + 1].hash;
+					actual = machine.StateHash();
+				}
+			}
+
+			if (segmentFailed)
+			{
+				std::lock_guard<std::mutex> lock(failureMutex);
+				if (!failed || failedFrame < result.divergedFrame)
+				{
+					failed = true;
+					result.divergedFrame = failedFrame;
+					result.expected = expected;
+					result.actual = actual;
+				}
+			}
+			else
+			{
+				checksPassed += checks;
+			}
+		}
+	};
+
+	std::vector<std::thread> pool;
+	for (unsigned int i = 1; i < threads; ++i)
+	{
+		pool.emplace_back(worker);
+	}
+	worker();
+	for (std::thread& thread : pool)
+	{
+		thread.join();
+	}
+
+	result.ok = !failed;
+	result.frames = failed ? result.divergedFrame : movie.frameCount;
+	result.checks = checksPassed;
+	return result;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+/*
+    Input movies: the keypad mask for every frame of a session, stored as runs, plus the ROM hash
+    and RNG seed needed to reproduce it and a state hash every hashInterval frames to verify
+    that a replay still ends up in exactly the same place. A savestate is embedded every
+    keyframeInterval frames so playback can start anywhere without replaying from frame 0.
+
+    File layout (little endian):
+
+    "C8MV" u8 version
+    u64 ROM hash, u64 seed, u32 cycles per frame, u32 hash interval, u32 keyframe interval
+    records, each starting with a tag byte:
+        'I' u16 mask, u32 frames                keys held for that many frames
+        'H' u32 frame, u64 hash                 state hash after that many frames
+        'K' u32 frame, u64 hash, u32 size, blob savestate after that many frames
+        'E' u32 frames                          end of movie, total frame count
+        'X' u32 count, count * (u32 frame, u64 offset)
+                                                keyframe index, file offset of each 'K' record
+    u64 offset of the 'X' record, "C8IX"        footer, so the index can be found from the end
+
+    Version 1 files have no keyframe interval, keyframes, index or footer.
+*/
+
+struct Movie
+{
+    struct InputRun {
+        uint32_t start;
+        uint16_t mask;
+    };
+    struct Check {
+        uint32_t frame;
+        uint64_t hash;
+    };
+    struct Keyframe {
+        uint32_t frame;
+        uint64_t hash;
+        uint64_t offset;
+    };
+
+    // reads inputs, checks and the keyframe index, keyframe states stay on disk until needed
+    bool Load(char const* path);
+    // keys held during the given frame
+    uint16_t KeysAt(uint32_t frame) const;
+    // last keyframe at or before the given frame, or -1 if there is none
+    int KeyframeBefore(uint32_t frame) const;
+    bool ReadKeyframe(int keyframe, std::vector<uint8_t>& blob) const;
+
+    uint64_t romHash{};
+    uint64_t seed{};
+    uint32_t cyclesPerFrame{};
+    uint32_t hashInterval{};
+    uint32_t keyframeInterval{};
+    uint32_t frameCount{};
+    std::vector<InputRun> inputs;
+    std::vector<Check> checks;
+    std::vector<Keyframe> keyframes;
+    std::string path;
+};
+
+class MovieRecorder
+{
+public:
+    // chip8 must be at power-on with its ROM loaded and seeded with seed
+    MovieRecorder(char const* path, Chip8 const& chip8, uint64_t seed, unsigned int cyclesPerFrame,
+        unsigned int hashInterval = 60, unsigned int keyframeInterval = 3600);
+    ~MovieRecorder();
+
+    bool IsOpen() const { return file.is_open(); }
+    // call after running each frame, with the keys it ran with
+    void Frame(uint16_t keys, Chip8 const& chip8);
+
+private:
+    void FlushRun();
+    void WriteKeyframe(Chip8 const& chip8);
+
+    std::ofstream file;
+    unsigned int hashInterval;
+    unsigned int keyframeInterval;
+    std::vector<Movie::Keyframe> keyframes;
+    uint32_t frame{};
+    uint16_t runMask{};
+    uint32_t runLength{};
+};
+
+struct PlaybackResult
+{
+    bool ok;
+    // the loaded ROM isn't the one the movie was recorded with, expected/actual are ROM hashes
+    bool romMismatch;
+    uint32_t frames;
+    uint32_t checks;
+    // first check that failed, when !ok
+    uint32_t divergedFrame;
+    uint64_t expected;
+    uint64_t actual;
+};
+
+// Replays the movie as fast as possible, stopping at the first failed check.
+// chip8 must be at power-on with the movie's ROM loaded, it is seeded from the movie.
+PlaybackResult PlayMovie(Movie const& movie, Chip8& chip8);
+
+// Verifies the movie on several threads at once: every keyframe-to-keyframe segment is replayed from
+// its starting keyframe, checking the hashes inside it and that it ends on the next keyframe's state.
+// chip8 must have the movie's ROM loaded, each thread works on its own clone of it.
+PlaybackResult VerifyMovie(Movie const& movie, Chip8 const& chip8, unsigned int threads);
+
+// Replays the movie's inputs and records them again with this build's own hashes and keyframes, for example
+// with a hash every frame so the recordings of two builds can be bisected. chip8 must be at power-on.
+bool RerecordMovie(Movie const& movie, Chip8& chip8, char const* path, unsigned int hashInterval, unsigned int keyframeInterval);
+
+// Puts chip8 in the state it had after the given number of frames by restoring the nearest keyframe
+// and replaying at most keyframeInterval frames. chip8 must have the movie's ROM loaded.
+bool SeekMovie(Movie const& movie, Chip8& chip8, uint32_t frame);
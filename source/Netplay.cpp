@@ -0,0 +1,344 @@
+#include "Netplay.hpp"
+#include <algorithm>
+#include <climits>
+#include <cstring>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+/*
+	Packets (all multi-byte values little endian):
+
+	"C8NP" u8 'H'  u8 player, u64 ROM hash, u64 seed, u32 cycles per frame, u8 whether the sender
+	               has heard from the receiver yet
+	"C8NP" u8 'I'  u32 ack (all of the receiver's inputs before this frame arrived),
+	               u32 first frame, u8 count, u16[count] key masks
+
+	Input packets carry every frame from the last acknowledged one on, so any single packet that
+	gets through fills the gaps left by lost ones.
+*/
+const uint8_t PACKET_MAGIC[4] = { 'C', '8', 'N', 'P' };
+const uint8_t PACKET_HELLO = 'H';
+const uint8_t PACKET_INPUT = 'I';
+const size_t PACKET_SIZE_MAX = 512;
+
+// inputs are kept for this many frames, far more than can be in flight
+const uint32_t INPUT_HISTORY = 256;
+const unsigned int INPUTS_PER_PACKET_MAX = 128;
+const unsigned int ROLLBACK_MAX = 60;
+
+static void PutBytes(std::vector<uint8_t>& out, uint64_t value, unsigned int size)
+{
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		out.push_back(uint8_t(value >> (8u * i)));
+	}
+}
+
+static uint64_t GetBytes(uint8_t const* in, unsigned int size)
+{
+	uint64_t value = 0;
+	for (unsigned int i = 0; i < size; ++i)
+	{
+		value |= uint64_t(in[i]) << (8u * i);
+	}
+	return value;
+}
+
+#ifdef _WIN32
+const intptr_t INVALID_HANDLE = intptr_t(INVALID_SOCKET);
+#else
+const intptr_t INVALID_HANDLE = -1;
+#endif
+
+UdpSocket::UdpSocket()
+{
+#ifdef _WIN32
+	// reference counted by winsock, every socket takes its own
+	WSADATA data;
+	WSAStartup(MAKEWORD(2, 2), &data);
+	handle = intptr_t(socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP));
+	u_long nonBlocking = 1;
+	if (handle != INVALID_HANDLE)
+	{
+		ioctlsocket(SOCKET(handle), FIONBIO, &nonBlocking);
+	}
+#else
+	handle = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (handle != INVALID_HANDLE)
+	{
+		fcntl(int(handle), F_SETFL, fcntl(int(handle), F_GETFL) | O_NONBLOCK);
+	}
+#endif
+}
+
+UdpSocket::~UdpSocket()
+{
+#ifdef _WIN32
+	if (handle != INVALID_HANDLE)
+	{
+		closesocket(SOCKET(handle));
+	}
+	WSACleanup();
+#else
+	if (handle != INVALID_HANDLE)
+	{
+		close(int(handle));
+	}
+#endif
+}
+
+bool UdpSocket::Bind(uint16_t port)
+{
+	sockaddr_in address{};
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+	return handle != INVALID_HANDLE && bind(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+}
+
+bool UdpSocket::Connect(char const* host, uint16_t port)
+{
+	addrinfo hints{};
+	hints.ai_family = AF_INET;
+	hints.ai_socktype = SOCK_DGRAM;
+	addrinfo* result = nullptr;
+	if (handle == INVALID_HANDLE || getaddrinfo(host, nullptr, &hints, &result) != 0)
+	{
+		return false;
+	}
+
+	sockaddr_in address;
+	memcpy(&address, result->ai_addr, sizeof(address));
+	address.sin_port = htons(port);
+	freeaddrinfo(result);
+
+	// a connected socket only hears from the peer
+	return connect(handle, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0;
+}
+
+void UdpSocket::Send(void const* data, size_t size)
+{
+	// a full buffer or an unreachable peer is just a lost packet
+	send(handle, static_cast<char const*>(data), int(size), 0);
+}
+
+size_t UdpSocket::Receive(void* data, size_t size)
+{
+	// errors (the peer's port not being open yet shows up as one) read as nothing waiting
+	auto received = recv(handle, static_cast<char*>(data), int(size), 0);
+	return received > 0 ? size_t(received) : 0;
+}
+
+Netplay::Netplay(Chip8& chip8, unsigned int player, uint64_t seed, uint16_t localPort, char const* remoteHost,
+	uint16_t remotePort, unsigned int cyclesPerFrame, unsigned int maxRollback)
+	: chip8(chip8),
+	  player(player),
+	  seed(seed),
+	  cyclesPerFrame(cyclesPerFrame),
+	  maxRollback(std::clamp(maxRollback, 1u, ROLLBACK_MAX)),
+	  rollbackFrame(UINT32_MAX),
+	  localInputs(INPUT_HISTORY),
+	  remoteInputs(INPUT_HISTORY),
+	  predictedInputs(INPUT_HISTORY),
+	  snapshots(this->maxRollback + 1)
+{
+	open = socket.Bind(localPort) && socket.Connect(remoteHost, remotePort);
+	lossRng.Seed(localPort);
+	chip8.Seed(seed);
+}
+
+bool Netplay::Handshake()
+{
+	if (!connected)
+	{
+		Receive();
+		SendHello();
+	}
+	return connected;
+}
+
+bool Netplay::AdvanceFrame(uint16_t localKeys)
+{
+	Receive();
+	Rollback();
+
+	// too far ahead of the peer, a rollback would need snapshots that are already gone
+	if (frame - std::min(remoteConfirmed, frame) >= maxRollback)
+	{
+		++stalls;
+		SendInputs();
+		return false;
+	}
+
+	localInputs[frame % INPUT_HISTORY] = localKeys;
+	RunFrame(frame);
+	++frame;
+	SendInputs();
+	return true;
+}
+
+void Netplay::Poll()
+{
+	Receive();
+	Rollback();
+	SendInputs();
+}
+
+void Netplay::Receive()
+{
+	uint8_t packet[PACKET_SIZE_MAX];
+	size_t size;
+
+	while ((size = socket.Receive(packet, sizeof(packet))) != 0)
+	{
+		if (size < sizeof(PACKET_MAGIC) + 1 || memcmp(packet, PACKET_MAGIC, sizeof(PACKET_MAGIC)) != 0)
+		{
+			continue;
+		}
+		uint8_t const* body = packet + sizeof(PACKET_MAGIC) + 1;
+		size -= sizeof(PACKET_MAGIC) + 1;
+
+		if (packet[sizeof(PACKET_MAGIC)] == PACKET_HELLO && size >= 22)
+		{
+			unsigned int remotePlayer = body[0];
+			uint64_t romHash = GetBytes(body + 1, 8);
+			uint64_t remoteSeed = GetBytes(body + 9, 8);
+			uint32_t remoteCycles = GetBytes(body + 17, 4);
+			bool heardFrom = body[21];
+
+			if (remotePlayer == player || romHash != chip8.RomHash() || remoteCycles != cyclesPerFrame)
+			{
+				mismatched = true;
+				continue;
+			}
+			if (!connected)
+			{
+				// both sides have to start from the same generator state
+				if (player != 1)
+				{
+					seed = remoteSeed;
+					chip8.Seed(seed);
+				}
+				connected = true;
+			}
+			if (!heardFrom)
+			{
+				// the peer is still waiting to hear from us
+				SendHello();
+			}
+		}
+		else if (packet[sizeof(PACKET_MAGIC)] == PACKET_INPUT && size >= 9 && connected)
+		{
+			uint32_t ack = GetBytes(body, 4);
+			uint32_t start = GetBytes(body + 4, 4);
+			unsigned int count = body[8];
+			if (size < 9 + 2 * count)
+			{
+				continue;
+			}
+			localAcked = std::max(localAcked, std::min(ack, frame));
+
+			// only extend the confirmed inputs without leaving a gap
+			for (uint32_t f = std::max(start, remoteConfirmed); f < start + count && f == remoteConfirmed; ++f)
+			{
+				uint16_t keys = GetBytes(body + 9 + 2 * (f - start), 2);
+				remoteInputs[f % INPUT_HISTORY] = keys;
+				if (f < frame && predictedInputs[f % INPUT_HISTORY] != keys)
+				{
+					rollbackFrame = std::min(rollbackFrame, f);
+				}
+				++remoteConfirmed;
+			}
+		}
+	}
+}
+
+void Netplay::Rollback()
+{
+	if (rollbackFrame >= frame)
+	{
+		rollbackFrame = UINT32_MAX;
+		return;
+	}
+
+	// back to the state before the first wrong guess, then everything since again with what is known now
+	// these frames ran once already, their faults are not logged twice
+	chip8.Restore(snapshots[rollbackFrame % snapshots.size()]);
+	chip8.MuteFaults(true);
+	for (uint32_t f = rollbackFrame; f < frame; ++f)
+	{
+		RunFrame(f);
+	}
+	chip8.MuteFaults(false);
+
+	++rollbacks;
+	resimulated += frame - rollbackFrame;
+	rollbackFrame = UINT32_MAX;
+}
+
+void Netplay::SendHello()
+{
+	std::vector<uint8_t> packet(PACKET_MAGIC, PACKET_MAGIC + sizeof(PACKET_MAGIC));
+	packet.push_back(PACKET_HELLO);
+	PutBytes(packet, player, 1);
+	PutBytes(packet, chip8.RomHash(), 8);
+	PutBytes(packet, seed, 8);
+	PutBytes(packet, cyclesPerFrame, 4);
+	PutBytes(packet, connected, 1);
+	Send(packet);
+}
+
+void Netplay::SendInputs()
+{
+	uint32_t start = std::max(localAcked, frame - std::min(frame, INPUTS_PER_PACKET_MAX));
+
+	std::vector<uint8_t> packet(PACKET_MAGIC, PACKET_MAGIC + sizeof(PACKET_MAGIC));
+	packet.push_back(PACKET_INPUT);
+	PutBytes(packet, remoteConfirmed, 4);
+	PutBytes(packet, start, 4);
+	PutBytes(packet, frame - start, 1);
+	for (uint32_t f = start; f < frame; ++f)
+	{
+		PutBytes(packet, localInputs[f % INPUT_HISTORY], 2);
+	}
+	Send(packet);
+}
+
+void Netplay::Send(std::vector<uint8_t> const& packet)
+{
+	if (lossPercent && lossRng.Next() % 100u < lossPercent)
+	{
+		return;
+	}
+	socket.Send(packet.data(), packet.size());
+}
+
+void Netplay::RunFrame(uint32_t frame)
+{
+	uint16_t remoteKeys = RemoteKeys(frame);
+
+	chip8.Capture(snapshots[frame % snapshots.size()]);
+	predictedInputs[frame % INPUT_HISTORY] = remoteKeys;
+	chip8.SetKeys(localInputs[frame % INPUT_HISTORY] | remoteKeys);
+	chip8.RunFrame(cyclesPerFrame);
+}
+
+uint16_t Netplay::RemoteKeys(uint32_t frame) const
+{
+	if (frame < remoteConfirmed)
+	{
+		return remoteInputs[frame % INPUT_HISTORY];
+	}
+	// not here yet, guess the keys are still held the way they last were
+	return remoteConfirmed ? remoteInputs[(remoteConfirmed - 1) % INPUT_HISTORY] : 0;
+}
@@ -0,0 +1,107 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Rng.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Non-blocking UDP socket, just enough for netplay.
+class UdpSocket
+{
+public:
+    UdpSocket();
+    ~UdpSocket();
+    UdpSocket(UdpSocket const&) = delete;
+    UdpSocket& operator=(UdpSocket const&) = delete;
+
+    bool Bind(uint16_t port);
+    bool Connect(char const* host, uint16_t port);
+    void Send(void const* data, size_t size);
+    // returns the number of bytes received, 0 when nothing is waiting
+    size_t Receive(void* data, size_t size);
+
+private:
+    intptr_t handle;
+};
+
+/*
+    Rollback netplay for two players sharing the keypad: each peer owns its own key mask and the
+    machine runs with both ORed together.
+
+    Every frame the local keys are sent to the peer (along with all the ones it hasn't acknowledged,
+    so lost packets don't matter) and the remote keys are predicted to be whatever they last were.
+    When the real remote keys turn out different, the machine is restored to the snapshot taken
+    before the first mispredicted frame and every frame since is run again without rendering.
+    A peer more than maxRollback frames ahead of the last confirmed remote input waits instead.
+*/
+class Netplay
+{
+public:
+    // player 1's seed wins, player 2 adopts it during the handshake
+    Netplay(Chip8& chip8, unsigned int player, uint64_t seed, uint16_t localPort, char const* remoteHost,
+        uint16_t remotePort, unsigned int cyclesPerFrame, unsigned int maxRollback = 8);
+
+    bool IsOpen() const { return open; }
+    // exchanges hellos until the peer answers, call every tick until it returns true
+    bool Handshake();
+    // the peer runs another ROM or frame length, or claims the same player number
+    bool Mismatched() const { return mismatched; }
+    // drops this percentage of outgoing packets, for testing
+    void SimulateLoss(unsigned int percent) { lossPercent = percent; }
+
+    // runs one frame with the local keys, false if stalled waiting for the peer
+    bool AdvanceFrame(uint16_t localKeys);
+    // receives, rolls back if needed and resends without advancing
+    void Poll();
+
+    uint64_t Seed() const { return seed; }
+    uint32_t Frame() const { return frame; }
+    // every frame before this one ran with confirmed inputs from both players
+    uint32_t ConfirmedFrame() const { return remoteConfirmed < frame ? remoteConfirmed : frame; }
+    // the peer has all of the local inputs before this frame
+    uint32_t AckedFrame() const { return localAcked; }
+    uint64_t Rollbacks() const { return rollbacks; }
+    uint64_t ResimulatedFrames() const { return resimulated; }
+    uint64_t Stalls() const { return stalls; }
+
+private:
+    void Receive();
+    void Rollback();
+    void SendHello();
+    void SendInputs();
+    void Send(std::vector<uint8_t> const& packet);
+    void RunFrame(uint32_t frame);
+    uint16_t RemoteKeys(uint32_t frame) const;
+
+    Chip8& chip8;
+    UdpSocket socket;
+    bool open{};
+    bool connected{};
+    bool mismatched{};
+    unsigned int player;
+    uint64_t seed;
+    unsigned int cyclesPerFrame;
+    unsigned int maxRollback;
+
+    uint32_t frame{};
+    // all remote inputs before this frame are known
+    uint32_t remoteConfirmed{};
+    // the peer has all of our inputs before this frame
+    uint32_t localAcked{};
+    // earliest frame that ran with a wrong prediction, or UINT32_MAX
+    uint32_t rollbackFrame;
+
+    unsigned int lossPercent{};
+    Rng lossRng;
+
+    // indexed by frame % INPUT_HISTORY
+    std::vector<uint16_t> localInputs;
+    std::vector<uint16_t> remoteInputs;
+    std::vector<uint16_t> predictedInputs;
+    // state before each of the last maxRollback frames
+    std::vector<Chip8::Snapshot> snapshots;
+
+    uint64_t rollbacks{};
+    uint64_t resimulated{};
+    uint64_t stalls{};
+};
@@ -1,4 +1,5 @@
 #include "Platform.hpp"
+#include "Trace.hpp"
 #include <SDL2/SDL.h>
 #include <stdio.h>
 
@@ -25,10 +26,17 @@ Platform::~Platform()
 
 void Platform::Update(void const* buffer, int pitch)
 {
-	SDL_UpdateTexture(texture, nullptr, buffer, pitch);
-	SDL_RenderClear(renderer);
-	SDL_RenderCopy(renderer, texture, nullptr, nullptr);
-	SDL_RenderPresent(renderer);
+	{
+		TRACE_SCOPE("upload");
+		SDL_UpdateTexture(texture, nullptr, buffer, pitch);
+	}
+	{
+		// waits for vsync where the driver has it on
+		TRACE_SCOPE("present");
+		SDL_RenderClear(renderer);
+		SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+		SDL_RenderPresent(renderer);
+	}
 }
 
 bool Platform::ProcessInput(uint8_t* keys)
@@ -55,6 +63,21 @@ bool Platform::ProcessInput(uint8_t* keys)
 						quit = true;
 					} break;
 
+					case SDLK_F5:
+					{
+						hotkeys |= HOTKEY_SAVE_STATE;
+					} break;
+
+					case SDLK_F9:
+					{
+						hotkeys |= HOTKEY_LOAD_STATE;
+					} break;
+
+					case SDLK_BACKSPACE:
+					{
+						heldHotkeys |= HOTKEY_REWIND;
+					} break;
+
 					case SDLK_x:
 					{
 						keys[0] = 1;
@@ -141,6 +164,11 @@ bool Platform::ProcessInput(uint8_t* keys)
 			{
 				switch (event.key.keysym.sym)
 				{
+					case SDLK_BACKSPACE:
+					{
+						heldHotkeys &= ~HOTKEY_REWIND;
+					} break;
+
 					case SDLK_x:
 					{
 						keys[0] = 0;
@@ -227,3 +255,10 @@ bool Platform::ProcessInput(uint8_t* keys)
 
 	return quit;
 }
+
+uint32_t Platform::TakeHotkeys()
+{
+	uint32_t pressed = hotkeys | heldHotkeys;
+	hotkeys = 0;
+	return pressed;
+}
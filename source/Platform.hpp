@@ -4,6 +4,14 @@ class SDL_Window;
 class SDL_Renderer;
 class SDL_Texture;
 
+// emulator controls outside the chip-8 keypad, reported by Platform::TakeHotkeys
+enum Hotkey : uint32_t
+{
+    HOTKEY_SAVE_STATE = 1u << 0, // F5
+    HOTKEY_LOAD_STATE = 1u << 1, // F9
+    HOTKEY_REWIND = 1u << 2,     // backspace, reported for as long as it is held
+};
+
 class Platform
 {
 public:
@@ -11,10 +19,14 @@ public:
     ~Platform();
     void Update(void const* buffer, int pitch);
     bool ProcessInput(uint8_t* keys);
+    // hotkeys pressed since the last call, plus the ones currently held down
+    uint32_t TakeHotkeys();
 
 private:
     SDL_Window* window{};
     SDL_Renderer* renderer{};
     SDL_Texture* texture{};
+    uint32_t hotkeys{};
+    uint32_t heldHotkeys{};
 
 };
\ No newline at end of file
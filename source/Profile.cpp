@@ -0,0 +1,191 @@
+#include "Profile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <iomanip>
+
+namespace
+{
+	char const* const FAMILY_NAMES[OPCODE_FAMILIES] = {
+		"NULL", "00E0", "00EE", "1nnn", "2nnn", "3xkk", "4xkk", "5xy0", "6xkk", "7xkk",
+		"8xy0", "8xy1", "8xy2", "8xy3", "8xy4", "8xy5", "8xy6", "8xy7", "8xyE", "9xy0",
+		"Annn", "Bnnn", "Cxkk", "Dxyn", "Ex9E", "ExA1", "Fx07", "Fx0A", "Fx15", "Fx18",
+		"Fx1E", "Fx29", "Fx33", "Fx55", "Fx65",
+	};
+	const unsigned int FAMILY_NULL = 0;
+	const unsigned int FAMILY_00E0 = 1;
+	const unsigned int FAMILY_1NNN = 3;
+	const unsigned int FAMILY_8XY0 = 10;
+	const unsigned int FAMILY_8XYE = 18;
+	const unsigned int FAMILY_9XY0 = 19;
+	const unsigned int FAMILY_EX9E = 24;
+	const unsigned int FAMILY_FX07 = 26;
+}
+
+Profile::Profile()
+{
+	nodes.push_back({0, NO_NODE, NO_NODE, NO_NODE, 0});
+}
+
+uint32_t Profile::Child(uint32_t node, uint16_t address)
+{
+	uint32_t* link = &nodes[node].firstChild;
+	for (; *link != NO_NODE; link = &nodes[*link].nextSibling)
+	{
+		if (nodes[*link].address == address)
+		{
+			return *link;
+		}
+	}
+	// the link points into nodes, so it is filled in before the push can move them
+	uint32_t child = uint32_t(nodes.size());
+	*link = child;
+	nodes.push_back({address, node, NO_NODE, NO_NODE, 0});
+	return child;
+}
+
+void Profile::Count(uint16_t pc, uint16_t opcode, std::span<const uint16_t> callees)
+{
+	++families[Family(opcode)];
+	++addresses[pc % MEMORY_SIZE];
+
+	uint32_t node = 0;
+	for (uint16_t callee : callees)
+	{
+		node = Child(node, callee);
+	}
+	++nodes[node].instructions;
+}
+
+void Profile::Merge(Profile const& other)
+{
+	for (unsigned int family = 0; family < OPCODE_FAMILIES; ++family)
+	{
+		families[family] += other.families[family];
+	}
+	for (unsigned int address = 0; address < MEMORY_SIZE; ++address)
+	{
+		addresses[address] += other.addresses[address];
+	}
+
+	// parents come before their children, so their counterparts here are known by then
+	std::vector<uint32_t> mapped(other.nodes.size(), 0);
+	for (uint32_t node = 1; node < other.nodes.size(); ++node)
+	{
+		mapped[node] = Child(mapped[other.nodes[node].parent], other.nodes[node].address);
+	}
+	for (uint32_t node = 0; node < other.nodes.size(); ++node)
+	{
+		nodes[mapped[node]].instructions += other.nodes[node].instructions;
+	}
+}
+
+uint64_t Profile::Instructions() const
+{
+	uint64_t total = 0;
+	for (uint64_t count : families)
+	{
+		total += count;
+	}
+	return total;
+}
+
+unsigned int Profile::Family(uint16_t opcode)
+{
+	// the same decoding as the core's dispatch tables
+	unsigned int low = opcode & 0x000Fu;
+	switch (opcode >> 12u)
+	{
+	case 0x0:
+		return low == 0x0 ? FAMILY_00E0 : low == 0xE ? FAMILY_00E0 + 1 : FAMILY_NULL;
+	case 0x8:
+		return low <= 0x7 ? FAMILY_8XY0 + low : low == 0xE ? FAMILY_8XYE : FAMILY_NULL;
+	case 0xE:
+		return low == 0xE ? FAMILY_EX9E : low == 0x1 ? FAMILY_EX9E + 1 : FAMILY_NULL;
+	case 0xF:
+		switch (opcode & 0x00FFu)
+		{
+		case 0x07: return FAMILY_FX07;
+		case 0x0A: return FAMILY_FX07 + 1;
+		case 0x15: return FAMILY_FX07 + 2;
+		case 0x18: return FAMILY_FX07 + 3;
+		case 0x1E: return FAMILY_FX07 + 4;
+		case 0x29: return FAMILY_FX07 + 5;
+		case 0x33: return FAMILY_FX07 + 6;
+		case 0x55: return FAMILY_FX07 + 7;
+		case 0x65: return FAMILY_FX07 + 8;
+		default: return FAMILY_NULL;
+		}
+	case 0x9:
+		return FAMILY_9XY0;
+	default:
+		// 1nnn to 7xkk, then Annn to Dxyn, one each
+		return (opcode >> 12u) < 0x8 ? FAMILY_1NNN + (opcode >> 12u) - 1 : FAMILY_9XY0 + (opcode >> 12u) - 0x9;
+	}
+}
+
+char const* Profile::FamilyName(unsigned int family)
+{
+	return family < OPCODE_FAMILIES ? FAMILY_NAMES[family] : "?";
+}
+
+void Profile::WriteCollapsed(std::ostream& out, std::string const& root) const
+{
+	std::string path;
+	for (uint32_t node = 0; node < nodes.size(); ++node)
+	{
+		if (nodes[node].instructions == 0)
+		{
+			continue;
+		}
+		// built leaf first, the stack is at most 16 deep
+		path.clear();
+		for (uint32_t at = node; at != 0; at = nodes[at].parent)
+		{
+			char name[16];
+			std::snprintf(name, sizeof(name), ";sub_%03x", nodes[at].address);
+			path.insert(0, name);
+		}
+		out << root << path << " " << nodes[node].instructions << "\n";
+	}
+}
+
+void Profile::WriteReport(std::ostream& out, unsigned int hotspots) const
+{
+	uint64_t total = std::max<uint64_t>(1, Instructions());
+	out << std::fixed << std::setprecision(2);
+
+	std::vector<unsigned int> order(OPCODE_FAMILIES);
+	for (unsigned int family = 0; family < OPCODE_FAMILIES; ++family)
+	{
+		order[family] = family;
+	}
+	std::stable_sort(order.begin(), order.end(), [this](unsigned int a, unsigned int b) { return families[a] > families[b]; });
+	out << "opcode   instructions      share\n";
+	for (unsigned int family : order)
+	{
+		if (families[family])
+		{
+			out << std::left << std::setw(8) << FamilyName(family) << std::right << std::setw(14) << families[family]
+				<< std::setw(10) << 100.0 * families[family] / total << "%\n";
+		}
+	}
+
+	std::vector<unsigned int> hottest;
+	for (unsigned int address = 0; address < MEMORY_SIZE; ++address)
+	{
+		if (addresses[address])
+		{
+			hottest.push_back(address);
+		}
+	}
+	std::stable_sort(hottest.begin(), hottest.end(), [this](unsigned int a, unsigned int b) { return addresses[a] > addresses[b]; });
+	hottest.resize(std::min<size_t>(hottest.size(), hotspots));
+	out << "\naddress  instructions      share\n";
+	for (unsigned int address : hottest)
+	{
+		char name[8];
+		std::snprintf(name, sizeof(name), "0x%03x", address);
+		out << std::left << std::setw(8) << name << std::right << std::setw(14) << addresses[address]
+			<< std::setw(10) << 100.0 * addresses[address] / total << "%\n";
+	}
+}
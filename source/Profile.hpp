@@ -0,0 +1,52 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstdint>
+#include <ostream>
+#include <span>
+#include <string>
+#include <vector>
+
+// one per OP_* handler of the core, in the order they are declared (OP_NULL first)
+const unsigned int OPCODE_FAMILIES = 35;
+
+// Where a ROM spends its instructions. A core built with CHIP8_PROFILE counts every instruction a
+// machine runs into the profile it was given with Chip8::UseProfile: by opcode family, by address,
+// and by call stack, the subroutines it is nested in found by walking the machine's stack. Every
+// instruction takes the same time on a CHIP-8, so counts are time. Not thread-safe, give every
+// thread its own and Merge them.
+class Profile
+{
+public:
+    Profile();
+
+    // callees are the entry addresses of the subroutines the instruction at pc runs in, outermost first
+    void Count(uint16_t pc, uint16_t opcode, std::span<const uint16_t> callees);
+    void Merge(Profile const& other);
+    uint64_t Instructions() const;
+
+    // which OP_* handler the core dispatches opcode to
+    static unsigned int Family(uint16_t opcode);
+    static char const* FamilyName(unsigned int family);
+
+    // "root;sub_2a4;sub_31c count" per call stack, what flamegraph.pl and speedscope read
+    void WriteCollapsed(std::ostream& out, std::string const& root) const;
+    // opcode families by count and the hottest addresses
+    void WriteReport(std::ostream& out, unsigned int hotspots) const;
+
+private:
+    // call stacks as a tree, node 0 being the top level of the ROM
+    struct Node {
+        uint16_t address;
+        uint32_t parent;
+        uint32_t firstChild;
+        uint32_t nextSibling;
+        uint64_t instructions;
+    };
+    static const uint32_t NO_NODE = UINT32_MAX;
+
+    uint32_t Child(uint32_t node, uint16_t address);
+
+    std::vector<Node> nodes;
+    uint64_t families[OPCODE_FAMILIES]{};
+    uint64_t addresses[MEMORY_SIZE]{};
+};
@@ -0,0 +1,242 @@
+#include "Rewind.hpp"
+#include <cstring>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable_v<Chip8::Snapshot>, "snapshots are diffed as raw bytes");
+
+const size_t SNAPSHOT_SIZE = sizeof(Chip8::Snapshot);
+// worst case for an encoded snapshot: every byte literal plus the run headers
+const size_t RECORD_SIZE_MAX = SNAPSHOT_SIZE + SNAPSHOT_SIZE / 2 + 16;
+// zero runs shorter than this are folded into the surrounding literal
+const size_t ZERO_RUN_MIN = 4;
+
+static uint8_t* PutVarint(uint8_t* out, size_t value)
+{
+	while (value >= 0x80u)
+	{
+		*out++ = (value & 0x7Fu) | 0x80u;
+		value >>= 7u;
+	}
+	*out++ = value;
+	return out;
+}
+
+static uint8_t const* GetVarint(uint8_t const* in, size_t& value)
+{
+	value = 0;
+	for (unsigned int shift = 0;; shift += 7)
+	{
+		uint8_t byte = *in++;
+		value |= size_t(byte & 0x7Fu) << shift;
+		if (!(byte & 0x80u))
+		{
+			return in;
+		}
+	}
+}
+
+// Encodes current XOR base as alternating (zero run, literal run) pairs, returns the encoded size.
+static size_t EncodeDelta(uint8_t const* current, uint8_t const* base, uint8_t* out)
+{
+	uint8_t diff[SNAPSHOT_SIZE];
+	for (size_t i = 0; i < SNAPSHOT_SIZE; ++i)
+	{
+		diff[i] = current[i] ^ base[i];
+	}
+
+	uint8_t* start = out;
+	size_t pos = 0;
+
+	while (pos < SNAPSHOT_SIZE)
+	{
+		// skip unchanged bytes a word at a time
+		size_t zeroStart = pos;
+		while (pos + 8 <= SNAPSHOT_SIZE)
+		{
+			uint64_t word;
+			memcpy(&word, &diff[pos], 8);
+			if (word)
+			{
+				break;
+			}
+			pos += 8;
+		}
+		while (pos < SNAPSHOT_SIZE && diff[pos] == 0)
+		{
+			++pos;
+		}
+		if (pos == SNAPSHOT_SIZE)
+		{
+			// trailing zeros are implied
+			break;
+		}
+
+		// literal runs until ZERO_RUN_MIN unchanged bytes in a row
+		size_t literalStart = pos;
+		size_t zeros = 0;
+		while (pos < SNAPSHOT_SIZE && zeros < ZERO_RUN_MIN)
+		{
+			zeros = diff[pos] ? 0 : zeros + 1;
+			++pos;
+		}
+		pos -= zeros;
+
+		out = PutVarint(out, literalStart - zeroStart);
+		out = PutVarint(out, pos - literalStart);
+		memcpy(out, &diff[literalStart], pos - literalStart);
+		out += pos - literalStart;
+	}
+
+	return out - start;
+}
+
+static void ApplyDelta(uint8_t const* in, size_t size, uint8_t* target)
+{
+	uint8_t const* end = in + size;
+	size_t pos = 0;
+
+	while (in < end)
+	{
+		size_t zeroRun;
+		size_t literal;
+		in = GetVarint(in, zeroRun);
+		in = GetVarint(in, literal);
+		pos += zeroRun;
+		for (size_t i = 0; i < literal; ++i)
+		{
+			target[pos + i] ^= in[i];
+		}
+		in += literal;
+		pos += literal;
+	}
+}
+
+Rewind::Rewind(size_t memoryBudget, unsigned int keyframeInterval)
+	: ring(memoryBudget > 4 * RECORD_SIZE_MAX ? memoryBudget : 4 * RECORD_SIZE_MAX),
+	  keyframeInterval(keyframeInterval),
+	  sinceKeyframe(keyframeInterval)
+{
+}
+
+void Rewind::Capture(Chip8 const& chip8)
+{
+	static const uint8_t zero[SNAPSHOT_SIZE]{};
+	uint8_t record[RECORD_SIZE_MAX];
+
+	chip8.Capture(scratch);
+
+	// keyframes are stored as a delta against all zero bytes, most of memory is empty anyway
+	bool isKeyframe = sinceKeyframe >= keyframeInterval;
+	uint8_t const* base = isKeyframe ? zero : reinterpret_cast<uint8_t const*>(&keyframe);
+	size_t size = EncodeDelta(reinterpret_cast<uint8_t const*>(&scratch), base, record);
+
+	size_t offset = Reserve(size);
+
+	if (!isKeyframe && sinceKeyframe >= keyframeInterval)
+	{
+		// making room evicted the keyframe this delta was against
+		size = EncodeDelta(reinterpret_cast<uint8_t const*>(&scratch), zero, record);
+		offset = Reserve(size);
+		isKeyframe = true;
+	}
+
+	memcpy(&ring[offset], record, size);
+	used += size;
+
+	if (isKeyframe)
+	{
+		keyframe = scratch;
+		keyOffset = offset;
+		keySize = size;
+		sinceKeyframe = 0;
+	}
+	++sinceKeyframe;
+
+	entries.push_back({offset, size, keyOffset, keySize});
+}
+
+bool Rewind::Pop(Chip8& chip8)
+{
+	if (entries.empty())
+	{
+		return false;
+	}
+
+	Entry entry = entries.back();
+	entries.pop_back();
+	used -= entry.size;
+
+	// rebuild the keyframe, then apply the delta on top of it
+	uint8_t* target = reinterpret_cast<uint8_t*>(&scratch);
+	memset(target, 0, SNAPSHOT_SIZE);
+
+	if (entry.keyOffset != entry.offset)
+	{
+		ApplyDelta(&ring[entry.keyOffset], entry.keySize, target);
+	}
+	ApplyDelta(&ring[entry.offset], entry.size, target);
+
+	chip8.Restore(scratch);
+
+	// the cached keyframe may have just been popped, start a fresh group on the next capture
+	sinceKeyframe = keyframeInterval;
+
+	return true;
+}
+
+void Rewind::Clear()
+{
+	entries.clear();
+	used = 0;
+	sinceKeyframe = keyframeInterval;
+}
+
+size_t Rewind::Reserve(size_t size)
+{
+	for (;;)
+	{
+		if (entries.empty())
+		{
+			return 0;
+		}
+
+		size_t tail = entries.front().offset;
+		size_t head = entries.back().offset + entries.back().size;
+
+		if (head > tail)
+		{
+			// live data is [tail, head), space at the end or wrap around to the start
+			if (head + size <= ring.size())
+			{
+				return head;
+			}
+			if (size < tail)
+			{
+				return 0;
+			}
+		}
+		else if (head + size < tail)
+		{
+			// live data wraps, the gap is [head, tail)
+			return head;
+		}
+
+		DropOldestGroup();
+	}
+}
+
+void Rewind::DropOldestGroup()
+{
+	size_t groupKey = entries.front().keyOffset;
+
+	while (!entries.empty() && entries.front().keyOffset == groupKey)
+	{
+		used -= entries.front().size;
+		entries.pop_front();
+	}
+
+	if (groupKey == keyOffset)
+	{
+		sinceKeyframe = keyframeInterval;
+	}
+}
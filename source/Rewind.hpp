@@ -0,0 +1,46 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Ring buffer of per-frame snapshots for stepping the machine back in time.
+// Every keyframeInterval-th snapshot is stored whole, the rest as an XOR+RLE delta
+// against the last keyframe, so a frame typically costs a few dozen bytes.
+class Rewind
+{
+public:
+    Rewind(size_t memoryBudget, unsigned int keyframeInterval = 60);
+
+    void Capture(Chip8 const& chip8);
+    // restores the newest snapshot and drops it, false once the buffer is empty
+    bool Pop(Chip8& chip8);
+    void Clear();
+
+    size_t Frames() const { return entries.size(); }
+    size_t MemoryUsed() const { return used; }
+
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+        // keyframe this entry is a delta of, itself for keyframes
+        size_t keyOffset;
+        size_t keySize;
+    };
+
+    size_t Reserve(size_t size);
+    void DropOldestGroup();
+
+    std::vector<uint8_t> ring;
+    std::deque<Entry> entries;
+    size_t used{};
+    size_t keyOffset{};
+    size_t keySize{};
+    unsigned int keyframeInterval;
+    unsigned int sinceKeyframe{};
+
+    Chip8::Snapshot scratch{};
+    Chip8::Snapshot keyframe{};
+};
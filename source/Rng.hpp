@@ -0,0 +1,39 @@
+#pragma once
+#include <cstdint>
+
+// xoshiro128**: 16 bytes of state, a handful of instructions per number and the same
+// sequence on every compiler, so a seed fully determines a run.
+struct Rng {
+    uint32_t state[4];
+
+    void Seed(uint64_t seed) {
+        // expand the seed with splitmix64, which never yields the all zero state
+        for(unsigned int i = 0; i < 4; i += 2) {
+            seed += 0x9E3779B97F4A7C15u;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30u)) * 0xBF58476D1CE4E5B9u;
+            z = (z ^ (z >> 27u)) * 0x94D049BB133111EBu;
+            z ^= z >> 31u;
+            state[i] = uint32_t(z);
+            state[i + 1] = uint32_t(z >> 32u);
+        }
+    }
+
+    uint32_t Next() {
+        uint32_t result = Rotl(state[1] * 5u, 7) * 9u;
+        uint32_t t = state[1] << 9u;
+
+        state[2] ^= state[0];
+        state[3] ^= state[1];
+        state[1] ^= state[2];
+        state[0] ^= state[3];
+        state[2] ^= t;
+        state[3] = Rotl(state[3], 11);
+
+        return result;
+    }
+
+    static uint32_t Rotl(uint32_t x, int k) {
+        return (x << k) | (x >> (32 - k));
+    }
+};
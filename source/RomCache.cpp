@@ -0,0 +1,107 @@
+#include "RomCache.hpp"
+#include <fstream>
+
+RomCache& RomCache::Instance()
+{
+	static RomCache cache;
+	return cache;
+}
+
+RomCache::~RomCache()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	if (loader.joinable())
+	{
+		loader.join();
+	}
+}
+
+void RomCache::Preload(std::string const& path)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (!entries.try_emplace(path, Entry{State::Queued, nullptr}).second)
+		{
+			return;
+		}
+		queue.push_back(path);
+
+		// started on first use, programs that never preload don't pay for the thread
+		if (!loader.joinable())
+		{
+			loader = std::thread(&RomCache::Run, this);
+		}
+	}
+	wake.notify_one();
+}
+
+RomHandle RomCache::Get(std::string const& path)
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	auto [found, inserted] = entries.try_emplace(path, Entry{State::Loading, nullptr});
+	// references to entries stay valid while the map grows, iterators don't
+	Entry& entry = found->second;
+
+	// nobody is working on it yet, so rather than wait our turn in the queue we load it ourselves
+	if (inserted || entry.state == State::Queued)
+	{
+		entry.state = State::Loading;
+		lock.unlock();
+		RomHandle image = Load(path);
+		lock.lock();
+
+		entry.image = image;
+		entry.state = State::Ready;
+		loaded.notify_all();
+		return image;
+	}
+
+	loaded.wait(lock, [&] { return entry.state == State::Ready; });
+	return entry.image;
+}
+
+RomHandle RomCache::Load(std::string const& path)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file.is_open())
+	{
+		return nullptr;
+	}
+	uint8_t buffer[ROM_SIZE_MAX];
+	file.read(reinterpret_cast<char*>(buffer), ROM_SIZE_MAX);
+	return MakeRomImage(std::span<const uint8_t>(buffer, size_t(file.gcount())));
+}
+
+void RomCache::Run()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	for (;;)
+	{
+		wake.wait(lock, [this] { return stopping || !queue.empty(); });
+		if (stopping)
+		{
+			return;
+		}
+		std::string path = std::move(queue.front());
+		queue.pop_front();
+
+		// Get may have claimed it in the meantime
+		Entry& entry = entries.at(path);
+		if (entry.state != State::Queued)
+		{
+			continue;
+		}
+		entry.state = State::Loading;
+		lock.unlock();
+		RomHandle image = Load(path);
+		lock.lock();
+
+		entry.image = image;
+		entry.state = State::Ready;
+		loaded.notify_all();
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include "Chip8.hpp"
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+
+// Process-wide cache of ROM images by path. Preload queues files for a background thread to read
+// and build, so that by the time a game is started (or restarted, or switched to) its image is
+// ready and Chip8::Reset(handle) only has to point the machine's memory at it. Every machine
+// running a ROM shares the one image.
+class RomCache
+{
+public:
+    static RomCache& Instance();
+
+    void Preload(std::string const& path);
+    // the image for path, waiting for a preload already under way or loading it right here if it
+    // is still queued or was never asked for; nullptr if the file can't be read
+    RomHandle Get(std::string const& path);
+
+private:
+    RomCache() = default;
+    ~RomCache();
+
+    enum class State { Queued, Loading, Ready };
+    struct Entry {
+        State state;
+        RomHandle image;
+    };
+
+    static RomHandle Load(std::string const& path);
+    void Run();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable loaded;
+    std::unordered_map<std::string, Entry> entries;
+    std::deque<std::string> queue;
+    std::thread loader;
+    bool stopping{};
+};
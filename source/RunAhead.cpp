@@ -0,0 +1,31 @@
+#include "RunAhead.hpp"
+#include <chrono>
+
+RunAhead::RunAhead(unsigned int frames, unsigned int cyclesPerFrame)
+	: frames(frames),
+	  cyclesPerFrame(cyclesPerFrame),
+	  ahead(0)
+{
+}
+
+Chip8 const& RunAhead::Run(Chip8 const& chip8)
+{
+	auto start = std::chrono::steady_clock::now();
+
+	// the copy keeps the current keys, they are the best guess for the frames that haven't happened yet
+	ahead = chip8;
+	// frames that may never happen: a fault still halts the copy as it will the machine, but it is
+	// logged and trapped on only once the machine really gets there
+	ahead.MuteFaults(true);
+	for (unsigned int frame = 0; frame < frames; ++frame)
+	{
+		ahead.RunFrame(cyclesPerFrame);
+	}
+
+	uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+	totalNanoseconds += ns;
+	worstNanoseconds = ns > worstNanoseconds ? ns : worstNanoseconds;
+	++runs;
+
+	return ahead;
+}
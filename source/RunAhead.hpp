@@ -0,0 +1,29 @@
+#pragma once
+#include "Chip8.hpp"
+#include <cstdint>
+
+// Hides a game's own input lag: after every real frame a copy of the machine runs a few frames
+// further with the same keys and that copy is what gets shown. The real machine is never touched,
+// the copy shares its memory pages until it writes to them, so dropping it is the restore.
+class RunAhead
+{
+public:
+    RunAhead(unsigned int frames, unsigned int cyclesPerFrame);
+
+    // runs ahead from the machine's current state, returns the machine to present
+    Chip8 const& Run(Chip8 const& chip8);
+
+    unsigned int Frames() const { return frames; }
+    uint64_t Runs() const { return runs; }
+    float AverageMicroseconds() const { return runs ? totalNanoseconds / 1000.0f / runs : 0.0f; }
+    float WorstMicroseconds() const { return worstNanoseconds / 1000.0f; }
+
+private:
+    unsigned int frames;
+    unsigned int cyclesPerFrame;
+    Chip8 ahead;
+
+    uint64_t runs{};
+    uint64_t totalNanoseconds{};
+    uint64_t worstNanoseconds{};
+};
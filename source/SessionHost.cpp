@@ -0,0 +1,193 @@
+#include "SessionHost.hpp"
+#include <algorithm>
+
+SessionHost::SessionHost(unsigned int threads, unsigned int cyclesPerFrame, Clock::duration framePeriod)
+	: cyclesPerFrame(cyclesPerFrame ? cyclesPerFrame : 1),
+	  framePeriod(framePeriod),
+	  pool(threads),
+	  timerThread(&SessionHost::RunTimers, this)
+{
+}
+
+SessionHost::~SessionHost()
+{
+	Stop();
+}
+
+unsigned int SessionHost::Open(Chip8 const& chip8)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	unsigned int id = unsigned(sessions.size());
+	sessions.push_back(std::make_unique<Session>(id, chip8));
+
+	Session& session = *sessions.back();
+	session.start = Clock::now();
+	session.handle = Run(session).handle;
+	session.waiting = true;
+	timers.push({session.start, id, ++session.generation});
+	timersChanged.notify_one();
+	return id;
+}
+
+void SessionHost::SetKeys(unsigned int session, uint16_t mask)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	Session& target = *sessions[session];
+	if (target.keys.exchange(mask) == mask || !target.waiting || !target.idle)
+	{
+		return;
+	}
+	// the entry for the end of the idle wait goes stale, this one takes its place
+	target.idle = false;
+	timers.push({Clock::now(), session, ++target.generation});
+	++wakeups;
+	timersChanged.notify_one();
+}
+
+void SessionHost::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if (stopping)
+		{
+			return;
+		}
+		stopping = true;
+	}
+	timersChanged.notify_all();
+	timerThread.join();
+
+	// sessions still running a frame see stopping when they next resume or end right away, either
+	// way every coroutine ends up suspended and can be destroyed
+	pool.Wait();
+	for (auto& session : sessions)
+	{
+		session->handle.destroy();
+	}
+}
+
+SessionHost::Stats SessionHost::GetStats() const
+{
+	return {framesRun, framesSkipped, wakeups, lateFrames, worstLateness, totalLateness};
+}
+
+unsigned int SessionHost::Sessions() const
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return unsigned(sessions.size());
+}
+
+uint64_t SessionHost::FrameAt(Session const& session, Clock::time_point now) const
+{
+	if (now <= session.start)
+	{
+		return 0;
+	}
+	return uint64_t((now - session.start + framePeriod - Clock::duration(1)) / framePeriod);
+}
+
+SessionHost::Task SessionHost::Run(Session& session)
+{
+	for (;;)
+	{
+		Clock::time_point deadline = Deadline(session, session.frame);
+		co_await Until{*this, session, deadline, false};
+		if (stopping)
+		{
+			co_return;
+		}
+
+		uint64_t lateness = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - deadline).count();
+		totalLateness += lateness;
+		for (uint64_t worst = worstLateness; lateness > worst && !worstLateness.compare_exchange_weak(worst, lateness);)
+		{
+		}
+
+		uint16_t keys = session.keys;
+		if (keys != session.chip8.KeyMask())
+		{
+			session.chip8.SetKeys(keys);
+			session.inputs.push_back({uint32_t(session.frame), keys});
+		}
+
+		// nothing happens but the timers counting down until a key or the timer, so rather than
+		// run those frames, sleep through them and count the timers down for the ones that passed
+		uint64_t idleCycles = session.chip8.IdleCycles();
+		uint64_t idleFrames = idleCycles / cyclesPerFrame;
+		if (idleFrames > 0)
+		{
+			uint64_t from = session.frame;
+			bool forever = idleCycles == Chip8::IDLE_FOREVER;
+			co_await Until{*this, session, forever ? Clock::time_point::max() : Deadline(session, from + idleFrames), true};
+			if (stopping)
+			{
+				co_return;
+			}
+
+			uint64_t passed = std::min(idleFrames, FrameAt(session, Clock::now()) - from);
+			session.chip8.SkipIdle(passed * cyclesPerFrame);
+			session.frame += passed;
+			framesSkipped += passed;
+			continue;
+		}
+
+		session.chip8.RunFrame(cyclesPerFrame);
+		++session.frame;
+		++framesRun;
+		if (onFrame)
+		{
+			onFrame(session.id, session.chip8);
+		}
+		if (Clock::now() > Deadline(session, session.frame))
+		{
+			++lateFrames;
+		}
+	}
+}
+
+void SessionHost::Schedule(Session& session, Clock::time_point deadline, bool idle)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	session.waiting = true;
+	session.idle = idle;
+	timers.push({deadline, session.id, ++session.generation});
+	timersChanged.notify_one();
+}
+
+void SessionHost::RunTimers()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	while (!stopping)
+	{
+		if (timers.empty())
+		{
+			timersChanged.wait(lock);
+			continue;
+		}
+		Timer next = timers.top();
+		Session& session = *sessions[next.session];
+		if (next.generation != session.generation)
+		{
+			timers.pop();
+			continue;
+		}
+		if (next.deadline > Clock::now())
+		{
+			// idle sessions waiting for a key have no deadline at all
+			if (next.deadline == Clock::time_point::max())
+			{
+				timersChanged.wait(lock);
+			}
+			else
+			{
+				timersChanged.wait_until(lock, next.deadline);
+			}
+			continue;
+		}
+
+		timers.pop();
+		session.waiting = false;
+		std::coroutine_handle<> handle = session.handle;
+		pool.Submit([handle](unsigned int) { handle.resume(); });
+	}
+}
@@ -0,0 +1,141 @@
+#pragma once
+#include "Chip8.hpp"
+#include "Movie.hpp"
+#include "WorkStealing.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// Hosts many sessions on a few threads. Each session's loop is a coroutine that runs one frame at
+// its deadline and then suspends until the next one, so a session costs a timer entry rather than
+// a thread. A session whose machine is idle (Fx0A waiting for a key, or spinning on the delay
+// timer) suspends until its input or its timer instead of running the frames, and on waking
+// fast-forwards the timers by exactly the frames that went by. Suspended sessions are resumed on a
+// work-stealing pool by a timer thread.
+class SessionHost
+{
+public:
+    using Clock = std::chrono::steady_clock;
+    // after every frame a session actually runs, on the thread that ran it
+    using FrameCallback = std::function<void(unsigned int session, Chip8 const& chip8)>;
+
+    struct Stats {
+        uint64_t framesRun;
+        // frames covered by fast-forwarding an idle machine instead of running them
+        uint64_t framesSkipped;
+        // idle sessions resumed early by input
+        uint64_t wakeups;
+        // frames not finished by the time the next one was due, and the worst and total delay
+        // between a frame's deadline and the moment it started
+        uint64_t lateFrames;
+        uint64_t worstLatenessNanoseconds;
+        uint64_t totalLatenessNanoseconds;
+    };
+
+    SessionHost(unsigned int threads, unsigned int cyclesPerFrame, Clock::duration framePeriod);
+    ~SessionHost();
+    SessionHost(SessionHost const&) = delete;
+    SessionHost& operator=(SessionHost const&) = delete;
+
+    void OnFrame(FrameCallback callback) { onFrame = std::move(callback); }
+
+    // starts a session on a copy of chip8 at the next frame boundary
+    unsigned int Open(Chip8 const& chip8);
+    // keys are picked up at the session's next frame, an idle session is woken for them
+    void SetKeys(unsigned int session, uint16_t mask);
+    // finishes the frames in flight and ends every session, after which they can be inspected
+    void Stop();
+
+    Stats GetStats() const;
+    unsigned int Sessions() const;
+    // only while stopped: the machine, how many frames it has been through, and the keys it saw
+    Chip8 const& Machine(unsigned int session) const { return sessions[session]->chip8; }
+    uint64_t Frame(unsigned int session) const { return sessions[session]->frame; }
+    std::vector<Movie::InputRun> const& Inputs(unsigned int session) const { return sessions[session]->inputs; }
+
+private:
+    struct Task {
+        struct promise_type {
+            Task get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+            std::suspend_always initial_suspend() noexcept { return {}; }
+            std::suspend_always final_suspend() noexcept { return {}; }
+            void return_void() {}
+            void unhandled_exception() { std::terminate(); }
+        };
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    struct Session {
+        Session(unsigned int id, Chip8 const& chip8) : id(id), chip8(chip8) {}
+
+        unsigned int id;
+        Chip8 chip8;
+        Clock::time_point start;
+        uint64_t frame{};
+        std::atomic<uint16_t> keys{};
+        std::vector<Movie::InputRun> inputs;
+        std::coroutine_handle<> handle;
+
+        // guarded by the host's mutex: whether the coroutine sits in the timer queue and may be
+        // woken early by input, and which of its entries there is current (a wakeup queues a new
+        // one and leaves the old one stale)
+        bool waiting{};
+        bool idle{};
+        uint64_t generation{};
+    };
+
+    struct Timer {
+        Clock::time_point deadline;
+        unsigned int session;
+        uint64_t generation;
+
+        bool operator>(Timer const& other) const { return deadline > other.deadline; }
+    };
+
+    // suspends the session until the deadline, or until input arrives if it is idle
+    struct Until {
+        SessionHost& host;
+        Session& session;
+        Clock::time_point deadline;
+        bool idle;
+
+        bool await_ready() const { return false; }
+        void await_suspend(std::coroutine_handle<>) { host.Schedule(session, deadline, idle); }
+        void await_resume() const {}
+    };
+
+    Task Run(Session& session);
+    void Schedule(Session& session, Clock::time_point deadline, bool idle);
+    void RunTimers();
+
+    Clock::time_point Deadline(Session const& session, uint64_t frame) const { return session.start + framePeriod * frame; }
+    // first frame boundary at or after now
+    uint64_t FrameAt(Session const& session, Clock::time_point now) const;
+
+    unsigned int cyclesPerFrame;
+    Clock::duration framePeriod;
+    FrameCallback onFrame;
+
+    std::vector<std::unique_ptr<Session>> sessions;
+    std::priority_queue<Timer, std::vector<Timer>, std::greater<Timer>> timers;
+    mutable std::mutex mutex;
+    std::condition_variable timersChanged;
+    std::atomic<bool> stopping{};
+
+    std::atomic<uint64_t> framesRun{};
+    std::atomic<uint64_t> framesSkipped{};
+    std::atomic<uint64_t> wakeups{};
+    std::atomic<uint64_t> lateFrames{};
+    std::atomic<uint64_t> worstLateness{};
+    std::atomic<uint64_t> totalLateness{};
+
+    WorkStealingPool pool;
+    std::thread timerThread;
+};
@@ -0,0 +1,118 @@
+#include "StateFile.hpp"
+#include "Trace.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#endif
+
+// puts the finished temporary file in place of the save in one step, the save stays as it was until then
+static bool Replace(std::string const& tempPath, std::string const& path)
+{
+#ifdef _WIN32
+	// rename refuses to replace an existing file here
+	return MoveFileExA(tempPath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+	return std::rename(tempPath.c_str(), path.c_str()) == 0;
+#endif
+}
+
+StateFileWriter::StateFileWriter()
+	: thread(&StateFileWriter::Run, this)
+{
+}
+
+StateFileWriter::~StateFileWriter()
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		quit = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void StateFileWriter::Write(std::string path, std::vector<uint8_t> blob)
+{
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		jobs.push_back({std::move(path), std::move(blob)});
+	}
+	wake.notify_one();
+}
+
+void StateFileWriter::Flush()
+{
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return jobs.empty() && !busy; });
+}
+
+std::vector<std::string> StateFileWriter::TakeFailures()
+{
+	std::lock_guard<std::mutex> lock(mutex);
+	return std::exchange(failures, {});
+}
+
+void StateFileWriter::Run()
+{
+	Trace::NameThread("state writer");
+	std::unique_lock<std::mutex> lock(mutex);
+
+	for (;;)
+	{
+		// pending writes are still finished when quitting
+		wake.wait(lock, [this] { return quit || !jobs.empty(); });
+		if (jobs.empty())
+		{
+			break;
+		}
+
+		Job job = std::move(jobs.front());
+		jobs.pop_front();
+		busy = true;
+		lock.unlock();
+
+		bool written;
+		{
+			TRACE_SCOPE("write state");
+			// write to a temporary file first so a crash mid-write can't destroy the previous save
+			std::string tempPath = job.path + ".tmp";
+			std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+			file.write(reinterpret_cast<char const*>(job.blob.data()), job.blob.size());
+			file.close();
+			written = file && Replace(tempPath, job.path);
+			if (!written)
+			{
+				std::remove(tempPath.c_str());
+			}
+		}
+
+		lock.lock();
+		if (!written)
+		{
+			failures.push_back(std::move(job.path));
+		}
+		busy = false;
+		if (jobs.empty())
+		{
+			idle.notify_all();
+		}
+	}
+}
+
+bool ReadStateFile(char const* path, std::vector<uint8_t>& blob)
+{
+	std::ifstream file(path, std::ios::binary);
+
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	blob.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
@@ -0,0 +1,41 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Writes savestates to disk on a background thread so saving never stalls a frame.
+class StateFileWriter
+{
+public:
+    StateFileWriter();
+    ~StateFileWriter();
+    // queues the blob and returns immediately
+    void Write(std::string path, std::vector<uint8_t> blob);
+    // blocks until every queued write has hit the disk
+    void Flush();
+    // paths of the writes that failed since the last call; a failed write leaves the previous save as it was
+    std::vector<std::string> TakeFailures();
+
+private:
+    struct Job {
+        std::string path;
+        std::vector<uint8_t> blob;
+    };
+
+    void Run();
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::deque<Job> jobs;
+    std::vector<std::string> failures;
+    bool busy{};
+    bool quit{};
+    std::thread thread;
+};
+
+bool ReadStateFile(char const* path, std::vector<uint8_t>& blob);
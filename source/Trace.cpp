@@ -0,0 +1,135 @@
+#include "Trace.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+std::atomic<bool> Trace::enabled{false};
+
+namespace
+{
+	struct Event
+	{
+		char const* name;
+		uint64_t begin;
+		uint64_t end;
+	};
+
+	// written only by its thread; recorded counts every event ever, the newest are kept
+	struct Buffer
+	{
+		unsigned int thread;
+		char const* name;
+		std::unique_ptr<Event[]> events;
+		std::atomic<uint64_t> recorded{};
+	};
+
+	std::chrono::steady_clock::time_point epoch;
+
+	// every buffer ever made, they outlive their threads so that Write still finds them
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<Buffer>> registry;
+
+	thread_local Buffer* threadBuffer;
+	thread_local char const* threadName;
+
+	Buffer& ThreadBuffer()
+	{
+		if (!threadBuffer)
+		{
+			auto buffer = std::make_unique<Buffer>();
+			buffer->name = threadName;
+			buffer->events = std::make_unique<Event[]>(TRACE_EVENTS_PER_THREAD);
+
+			std::lock_guard<std::mutex> lock(registryMutex);
+			buffer->thread = unsigned(registry.size()) + 1;
+			threadBuffer = buffer.get();
+			registry.push_back(std::move(buffer));
+		}
+		return *threadBuffer;
+	}
+
+	void WriteString(FILE* file, char const* text)
+	{
+		std::fputc('"', file);
+		for (; *text; ++text)
+		{
+			if (*text == '"' || *text == '\\')
+			{
+				std::fputc('\\', file);
+			}
+			std::fputc(*text, file);
+		}
+		std::fputc('"', file);
+	}
+}
+
+void Trace::Start()
+{
+	epoch = std::chrono::steady_clock::now();
+	enabled.store(true, std::memory_order_release);
+}
+
+uint64_t Trace::Clock()
+{
+	uint64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+	return std::max<uint64_t>(now, 1);
+}
+
+void Trace::Record(char const* name, uint64_t begin, uint64_t end)
+{
+	Buffer& buffer = ThreadBuffer();
+	uint64_t index = buffer.recorded.load(std::memory_order_relaxed);
+	buffer.events[index % TRACE_EVENTS_PER_THREAD] = {name, begin, end};
+	buffer.recorded.store(index + 1, std::memory_order_release);
+}
+
+void Trace::NameThread(char const* name)
+{
+	threadName = name;
+	if (threadBuffer)
+	{
+		threadBuffer->name = name;
+	}
+}
+
+bool Trace::Write(std::string const& path)
+{
+	FILE* file = std::fopen(path.c_str(), "w");
+	if (!file)
+	{
+		return false;
+	}
+
+	std::fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+	bool first = true;
+	std::lock_guard<std::mutex> lock(registryMutex);
+	for (auto const& buffer : registry)
+	{
+		if (buffer->name)
+		{
+			std::fprintf(file, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %u, \"args\": {\"name\": ", first ? "" : ",\n", buffer->thread);
+			WriteString(file, buffer->name);
+			std::fprintf(file, "}}");
+			first = false;
+		}
+
+		// the newest events in the order they were recorded, which is the order they ended in
+		uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+		uint64_t oldest = recorded > TRACE_EVENTS_PER_THREAD ? recorded - TRACE_EVENTS_PER_THREAD : 0;
+		for (uint64_t index = oldest; index < recorded; ++index)
+		{
+			Event const& event = buffer->events[index % TRACE_EVENTS_PER_THREAD];
+			// complete events in microseconds
+			std::fprintf(file, "%s{\"name\": ", first ? "" : ",\n");
+			WriteString(file, event.name);
+			std::fprintf(file, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+				buffer->thread, event.begin / 1e3, (event.end - event.begin) / 1e3);
+			first = false;
+		}
+	}
+	std::fprintf(file, "\n]}\n");
+	return std::fclose(file) == 0;
+}
@@ -0,0 +1,55 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// events a thread keeps, older ones are overwritten once it has recorded more
+const size_t TRACE_EVENTS_PER_THREAD = 1 << 16;
+
+// Timeline of what the threads were doing, written as a Chrome trace (chrome://tracing, Perfetto)
+// so a hitch can be pinned on a stage of the frame without a profiler attached. Each thread
+// records into a buffer of its own with plain stores, nothing is shared while tracing, and Write
+// collects them all at the end, which has to happen once the traced threads are quiet. While not
+// started, a scope costs one relaxed load.
+class Trace
+{
+public:
+    static void Start();
+    static bool Enabled() { return enabled.load(std::memory_order_relaxed); }
+    // nanoseconds since Start (never 0 once started), 0 while not started
+    static uint64_t Now() { return Enabled() ? Clock() : 0; }
+    // name has to outlive the trace, in practice a string literal
+    static void Record(char const* name, uint64_t begin, uint64_t end);
+    // shown for the calling thread instead of its number
+    static void NameThread(char const* name);
+    // false if the file can't be written
+    static bool Write(std::string const& path);
+
+private:
+    static uint64_t Clock();
+    static std::atomic<bool> enabled;
+};
+
+// records the time from construction to the end of the scope
+class TraceScope
+{
+public:
+    explicit TraceScope(char const* name) : name(name), begin(Trace::Now()) {}
+    ~TraceScope()
+    {
+        // begun before tracing started, or not traced at all
+        if (begin) {
+            Trace::Record(name, begin, Trace::Now());
+        }
+    }
+    TraceScope(TraceScope const&) = delete;
+    TraceScope& operator=(TraceScope const&) = delete;
+
+private:
+    char const* name;
+    uint64_t begin;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(traceScope, __LINE__)(name)
@@ -0,0 +1,128 @@
+#include "WorkStealing.hpp"
+#include <chrono>
+
+WorkStealingPool::WorkStealingPool(unsigned int threads)
+{
+	for (unsigned int i = 0; i < (threads ? threads : 1); ++i)
+	{
+		workers.push_back(std::make_unique<Worker>());
+	}
+	// all deques exist before any worker looks for something to steal
+	for (unsigned int i = 0; i < workers.size(); ++i)
+	{
+		workers[i]->thread = std::thread(&WorkStealingPool::Run, this, i);
+	}
+}
+
+WorkStealingPool::~WorkStealingPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (auto& worker : workers)
+	{
+		worker->thread.join();
+	}
+}
+
+void WorkStealingPool::Submit(unsigned int worker, Task task)
+{
+	++pending;
+	{
+		std::lock_guard<std::mutex> lock(workers[worker % workers.size()]->mutex);
+		workers[worker % workers.size()]->tasks.push_back(std::move(task));
+	}
+	++queued;
+
+	// taking the lock orders this against a worker that just found nothing and is about to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+void WorkStealingPool::Submit(Task task)
+{
+	Submit(nextWorker++, std::move(task));
+}
+
+void WorkStealingPool::Wait()
+{
+	std::unique_lock<std::mutex> lock(sleepMutex);
+	done.wait(lock, [this] { return pending == 0; });
+}
+
+std::vector<WorkStealingPool::WorkerStats> WorkStealingPool::Stats() const
+{
+	std::vector<WorkerStats> stats;
+	for (auto const& worker : workers)
+	{
+		stats.push_back({worker->executed, worker->stolen, worker->busyNanoseconds});
+	}
+	return stats;
+}
+
+void WorkStealingPool::Run(unsigned int worker)
+{
+	Worker& self = *workers[worker];
+
+	for (;;)
+	{
+		Task task;
+		if (!Take(worker, task))
+		{
+			std::unique_lock<std::mutex> lock(sleepMutex);
+			wake.wait(lock, [this] { return stopping || queued > 0; });
+			if (stopping)
+			{
+				return;
+			}
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		task(worker);
+		self.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+		++self.executed;
+
+		if (--pending == 0)
+		{
+			std::lock_guard<std::mutex> lock(sleepMutex);
+			done.notify_all();
+		}
+	}
+}
+
+bool WorkStealingPool::Take(unsigned int worker, Task& task)
+{
+	{
+		// newest first from our own deque, it is the most likely to still be in cache
+		Worker& self = *workers[worker];
+		std::lock_guard<std::mutex> lock(self.mutex);
+		if (!self.tasks.empty())
+		{
+			task = std::move(self.tasks.back());
+			self.tasks.pop_back();
+			--queued;
+			return true;
+		}
+	}
+
+	// oldest first from the others, that is the work its owner would get to last
+	for (size_t i = 1; i < workers.size(); ++i)
+	{
+		Worker& victim = *workers[(worker + i) % workers.size()];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (!victim.tasks.empty())
+		{
+			task = std::move(victim.tasks.front());
+			victim.tasks.pop_front();
+			--queued;
+			++workers[worker]->stolen;
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,65 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Thread pool where every worker has its own deque of tasks. A worker takes its newest task
+// first and, once its deque is empty, steals the oldest task of another worker. Tasks can
+// submit more tasks to their own worker, so a long job is run as a chain of short slices that
+// idle workers can pick up one at a time.
+class WorkStealingPool
+{
+public:
+    using Task = std::function<void(unsigned int worker)>;
+
+    struct WorkerStats {
+        uint64_t tasks;
+        uint64_t steals;
+        uint64_t busyNanoseconds;
+    };
+
+    explicit WorkStealingPool(unsigned int threads);
+    ~WorkStealingPool();
+    WorkStealingPool(WorkStealingPool const&) = delete;
+    WorkStealingPool& operator=(WorkStealingPool const&) = delete;
+
+    // onto the given worker's deque, a task passes its own worker to keep follow-up work local
+    void Submit(unsigned int worker, Task task);
+    // spread over the workers in turn
+    void Submit(Task task);
+    // blocks until every task has run, including the ones submitted by other tasks
+    void Wait();
+
+    unsigned int Threads() const { return unsigned(workers.size()); }
+    std::vector<WorkerStats> Stats() const;
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+        std::atomic<uint64_t> executed{};
+        std::atomic<uint64_t> stolen{};
+        std::atomic<uint64_t> busyNanoseconds{};
+    };
+
+    void Run(unsigned int worker);
+    bool Take(unsigned int worker, Task& task);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    // tasks sitting in deques, and tasks submitted but not finished yet
+    std::atomic<size_t> queued{};
+    std::atomic<size_t> pending{};
+    std::atomic<unsigned int> nextWorker{};
+
+    std::mutex sleepMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool stopping{};
+};
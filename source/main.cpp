@@ -1,20 +1,107 @@
 #include "Platform.hpp"
 #include "Chip8.hpp"
+#include "FaultLog.hpp"
+#include "Trace.hpp"
+#ifdef CHIP8_EMBEDDED_ROM
+#include "EmbeddedRom.hpp"
+#endif
+#include "StateFile.hpp"
+#include "Rewind.hpp"
+#include "Movie.hpp"
+#include "Netplay.hpp"
+#include "RunAhead.hpp"
+#include <memory>
 #include <chrono>
 #include <iostream>
+#include <string>
 
 
-int main(int argc, char** argv) {
-    if (argc != 4){
+#ifdef CHIP8_EMBEDDED_ROM
+const int POSITIONAL_ARGS = 3;
+#else
+const int POSITIONAL_ARGS = 4;
+#endif
 
-		std::cerr << "Usage: " << argv[0] << " <Scale> <Delay> <ROM>\n";
-		std::exit(EXIT_FAILURE);
+static void PrintUsage(char const* program) {
+#ifdef CHIP8_EMBEDDED_ROM
+    std::cerr << "Usage: " << program << " <Scale> <Delay> [options]\n";
+#else
+    std::cerr << "Usage: " << program << " <Scale> <Delay> <ROM> [options]\n";
+#endif
+    std::cerr << "  --rewind-mb <MB>   memory for the rewind buffer, hold backspace to rewind (default 16)\n";
+    std::cerr << "  --seed <N>         seed for the random number generator (default: clock)\n";
+    std::cerr << "  --record <file>    record an input movie, replay it with chip8-replay\n";
+    std::cerr << "  --runahead <N>     show N frames ahead of the machine to hide a game's input lag\n";
+    std::cerr << "  --faults <policy>  what a ROM fault does: ignore, count (default), halt or trap\n";
+    std::cerr << "  --trace <file>     write a Chrome trace of every frame's stages there on exit\n";
+    std::cerr << "  --netplay <1|2> <local port> <host> <port>\n";
+    std::cerr << "                     play together with another instance, player 1's seed is used\n";
+    std::exit(EXIT_FAILURE);
+}
 
+int main(int argc, char** argv) {
+    if (argc < POSITIONAL_ARGS){
+        PrintUsage(argv[0]);
 	}
 
     int videoScale = std::stoi(argv[1]);
 	int cycleDelay = std::stoi(argv[2]);
-	char const* romFilename = argv[3];
+    size_t rewindBudget = size_t(16) << 20;
+    bool seeded = false;
+    uint64_t seed = 0;
+    char const* moviePath = nullptr;
+    unsigned int netplayPlayer = 0;
+    uint16_t netplayLocalPort = 0;
+    char const* netplayHost = nullptr;
+    uint16_t netplayRemotePort = 0;
+    unsigned int runAheadFrames = 0;
+    Chip8::FaultPolicy faultPolicy = Chip8::FaultPolicy::Count;
+    char const* tracePath = nullptr;
+
+    for (int i = POSITIONAL_ARGS; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--rewind-mb" && i + 1 < argc) {
+            rewindBudget = std::stoul(argv[++i]) << 20;
+        } else if (option == "--seed" && i + 1 < argc) {
+            seeded = true;
+            seed = std::stoull(argv[++i]);
+        } else if (option == "--record" && i + 1 < argc) {
+            moviePath = argv[++i];
+        } else if (option == "--runahead" && i + 1 < argc) {
+            runAheadFrames = std::stoul(argv[++i]);
+        } else if (option == "--faults" && i + 1 < argc) {
+            std::string policy = argv[++i];
+            if (policy == "ignore") {
+                faultPolicy = Chip8::FaultPolicy::Ignore;
+            } else if (policy == "count") {
+                faultPolicy = Chip8::FaultPolicy::Count;
+            } else if (policy == "halt") {
+                faultPolicy = Chip8::FaultPolicy::Halt;
+            } else if (policy == "trap") {
+                faultPolicy = Chip8::FaultPolicy::Trap;
+            } else {
+                PrintUsage(argv[0]);
+            }
+        } else if (option == "--trace" && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (option == "--netplay" && i + 4 < argc) {
+            netplayPlayer = std::stoul(argv[++i]);
+            netplayLocalPort = std::stoul(argv[++i]);
+            netplayHost = argv[++i];
+            netplayRemotePort = std::stoul(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+        }
+    }
+    if (netplayHost && (moviePath || (netplayPlayer != 1 && netplayPlayer != 2))) {
+        // a movie would record predicted inputs that later get rolled back
+        PrintUsage(argv[0]);
+    }
+
+    if (tracePath) {
+        Trace::Start();
+        Trace::NameThread("main");
+    }
 
     uint32_t videoColorized[VIDEO_WIDTH * VIDEO_HEIGHT]{};
     uint32_t BLACK_COLOR = 0x33333333;
@@ -22,10 +109,58 @@ int main(int argc, char** argv) {
 
     Platform platform("Chip-8 Emulator", VIDEO_WIDTH * videoScale, VIDEO_HEIGHT * videoScale, VIDEO_WIDTH, VIDEO_HEIGHT);
 
+    if ((moviePath || netplayHost) && !seeded) {
+        // a movie needs to know the seed to be replayable, and netplay peers have to share it
+        seeded = true;
+        seed = std::chrono::system_clock::now().time_since_epoch().count();
+    }
+
     Chip8 chip8;
-    chip8.LoadROM(romFilename);
+    chip8.SetFaultPolicy(faultPolicy);
+    if (seeded) {
+        chip8.Seed(seed);
+    }
+#ifdef CHIP8_EMBEDDED_ROM
+    chip8.LoadROM(embeddedRom);
+    std::string statePath = "embedded.state";
+#else
+    chip8.LoadROM(argv[3]);
+    std::string statePath = std::string(argv[3]) + ".state";
+#endif
+
+    StateFileWriter stateWriter;
+    Rewind rewind(rewindBudget);
+
+    std::unique_ptr<MovieRecorder> recorder;
+    if (moviePath) {
+        // one cycle per frame, matching the loop below
+        recorder = std::make_unique<MovieRecorder>(moviePath, chip8, seed, 1);
+        if (!recorder->IsOpen()) {
+            std::cerr << "Could not open " << moviePath << " for recording\n";
+            std::exit(EXIT_FAILURE);
+        }
+        std::cerr << "Recording, rewind and loading states are disabled\n";
+    }
 
-    int videoPitch = sizeof(chip8.video[0]) * VIDEO_WIDTH;
+    // both players' keys end up in chip8.keypad, the local ones are kept apart
+    uint8_t localKeypad[KEY_COUNT]{};
+    std::unique_ptr<Netplay> netplay;
+    if (netplayHost) {
+        // one cycle per frame here, so allow a longer rollback than the default
+        netplay = std::make_unique<Netplay>(chip8, netplayPlayer, seed, netplayLocalPort, netplayHost, netplayRemotePort, 1, 60);
+        if (!netplay->IsOpen()) {
+            std::cerr << "Could not open port " << netplayLocalPort << " for netplay\n";
+            std::exit(EXIT_FAILURE);
+        }
+        std::cerr << "Waiting for player " << 3 - netplayPlayer << ", rewind and loading states are disabled\n";
+    }
+
+    std::unique_ptr<RunAhead> runAhead;
+    if (runAheadFrames) {
+        runAhead = std::make_unique<RunAhead>(runAheadFrames, 1);
+    }
+
+    int videoPitch = sizeof(videoColorized[0]) * VIDEO_WIDTH;
 
     auto lastCycleTime = std::chrono::high_resolution_clock::now();
 	bool quit = false;
@@ -33,26 +168,107 @@ int main(int argc, char** argv) {
 
     while(!quit) 
     {
-        quit = platform.ProcessInput(chip8.keypad);
+        uint64_t inputBegin = Trace::Now();
+        quit = platform.ProcessInput(netplay ? localKeypad : chip8.keypad);
+        uint64_t inputEnd = Trace::Now();
+
+        uint32_t hotkeys = platform.TakeHotkeys();
+        if (recorder || netplay) {
+            // jumping around would make the movie unreplayable
+            hotkeys &= ~(HOTKEY_LOAD_STATE | HOTKEY_REWIND);
+        }
+        if (hotkeys & HOTKEY_SAVE_STATE) {
+            // snapshot now, the file is written in the background
+            stateWriter.Write(statePath, chip8.SaveState());
+        }
+        if (hotkeys & HOTKEY_LOAD_STATE) {
+            std::vector<uint8_t> blob;
+            stateWriter.Flush();
+            if (!ReadStateFile(statePath.c_str(), blob) || !chip8.LoadState(blob)) {
+                std::cerr << "Could not load state from " << statePath << "\n";
+            }
+        }
 
         auto currentTime = std::chrono::high_resolution_clock::now();
 		float dt = std::chrono::duration<float, std::chrono::milliseconds::period>(currentTime - lastCycleTime).count();
 
         if (dt > cycleDelay) {
 			lastCycleTime = currentTime;
-            chip8.Cycle();
-            for(unsigned int i = 0; i < (VIDEO_HEIGHT * VIDEO_WIDTH); ++i){
-                if(chip8.video[i] == 0xFFFFFFFFu){
-                    videoColorized[i] = 0x84b88900u;
+            TRACE_SCOPE("frame");
+            // the loop polls input over and over between frames, only the poll this frame got its keys from counts
+            if (inputBegin) {
+                Trace::Record("input", inputBegin, inputEnd);
+            }
+            {
+                TRACE_SCOPE("emulate");
+                if (netplay) {
+                    if (netplay->Mismatched()) {
+                        std::cerr << "The other player runs another ROM or is also player " << netplayPlayer << "\n";
+                        std::exit(EXIT_FAILURE);
+                    }
+                    uint16_t localKeys = 0;
+                    for (unsigned int key = 0; key < KEY_COUNT; ++key) {
+                        localKeys |= (localKeypad[key] ? 1u : 0u) << key;
+                    }
+                    // a stalled frame just shows the last one again
+                    if (netplay->Handshake()) {
+                        netplay->AdvanceFrame(localKeys);
+                    }
+                } else if (hotkeys & HOTKEY_REWIND) {
+                    // step back one frame per tick while held, stop at the oldest one kept
+                    rewind.Pop(chip8);
                 } else {
-                    videoColorized[i] = 0x1d442100u;
+                    chip8.Cycle();
+                    rewind.Capture(chip8);
+                    if (recorder) {
+                        recorder->Frame(chip8.KeyMask(), chip8);
+                    }
+                }
+            }
+            // while rewinding the past is shown as it was
+            Chip8 const* shown = &chip8;
+            if (runAhead && !(hotkeys & HOTKEY_REWIND)) {
+                TRACE_SCOPE("run-ahead");
+                shown = &runAhead->Run(chip8);
+            }
+            {
+                TRACE_SCOPE("colorize");
+                for(unsigned int i = 0; i < (VIDEO_HEIGHT * VIDEO_WIDTH); ++i){
+                    if(shown->Pixel(i % VIDEO_WIDTH, i / VIDEO_WIDTH)){
+                        videoColorized[i] = 0x84b88900u;
+                    } else {
+                        videoColorized[i] = 0x1d442100u;
+                    }
                 }
             }
 
 			platform.Update(videoColorized, videoPitch);
+			// faults are only queued while running, printing them is left to here
+			FaultLog::Instance().Drain(std::cerr);
+			for (std::string const& path : stateWriter.TakeFailures()) {
+				std::cerr << "Could not save state to " << path << "\n";
+			}
 		}
 
 
+    }
+    // a save made just before quitting is reported too
+    stateWriter.Flush();
+    for (std::string const& path : stateWriter.TakeFailures()) {
+        std::cerr << "Could not save state to " << path << "\n";
+    }
+    if (tracePath && !Trace::Write(tracePath)) {
+        std::cerr << "Could not write the trace to " << tracePath << "\n";
+    }
+    if (runAhead) {
+        // one frame per tick, so every frame run ahead takes a tick off the time until a key press shows
+        std::cerr << "Run-ahead: " << runAhead->Frames() << " frames, effective latency " << runAhead->Frames() * cycleDelay
+            << " ms lower, " << runAhead->AverageMicroseconds() << " us per frame on average, "
+            << runAhead->WorstMicroseconds() << " us at worst\n";
+    }
+    if (netplay) {
+        std::cerr << "Netplay: " << netplay->Frame() << " frames, " << netplay->Rollbacks() << " rollbacks, "
+            << netplay->ResimulatedFrames() << " frames resimulated, " << netplay->Stalls() << " stalls\n";
     }
     return 0;
 
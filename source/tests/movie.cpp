@@ -0,0 +1,88 @@
+#include "../Chip8.hpp"
+#include "../Movie.hpp"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Checks that movie verification catches damage wherever it is, the power-on keyframe included.
+// Run by make check.
+
+static int failures = 0;
+
+static void Expect(bool condition, char const* what) {
+    if (!condition) {
+        std::cerr << "FAIL: " << what << "\n";
+        ++failures;
+    }
+}
+
+// a counter drawn to the screen, so that every frame changes the state
+static const uint8_t ROM[] = {
+    0x70, 0x01, // add V0, 1
+    0xF0, 0x29, // I = font digit of V0
+    0xD0, 0x05, // draw it at (V0, V0)
+    0x12, 0x00, // jump back
+};
+
+static void Record(char const* path, uint32_t frames, unsigned int keyframeInterval) {
+    Chip8 chip8(7);
+    chip8.LoadROM(ROM);
+    MovieRecorder recorder(path, chip8, 7, 10, 10, keyframeInterval);
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        chip8.SetKeys(frame % 7);
+        chip8.RunFrame(10);
+        recorder.Frame(frame % 7, chip8);
+    }
+}
+
+static PlaybackResult Verify(Movie const& movie) {
+    Chip8 chip8(0);
+    chip8.LoadROM(ROM);
+    return VerifyMovie(movie, chip8, 4);
+}
+
+int main() {
+    std::string path = "chip8-test-movie.c8mv";
+
+    // a single keyframe, the power-on one, and nothing wrong with it
+    Record(path.c_str(), 500, 3600);
+    Movie movie;
+    Expect(movie.Load(path.c_str()), "the movie loads");
+    Expect(movie.keyframes.size() == 1, "a short movie has only the power-on keyframe");
+    PlaybackResult result = Verify(movie);
+    Expect(result.ok && result.checks == 50, "an intact movie verifies with all its checks");
+
+    // the power-on keyframe's hash no longer matches its state
+    Movie wrongHash = movie;
+    wrongHash.keyframes[0].hash ^= 1;
+    result = Verify(wrongHash);
+    Expect(!result.ok && result.divergedFrame == 0, "a bad hash on keyframe 0 fails at frame 0");
+
+    // the power-on keyframe's savestate can't be read back
+    {
+        std::fstream file(path, std::ios::in | std::ios::out | std::ios::binary);
+        // size field of the 'K' record, past its tag, frame and hash
+        file.seekp(movie.keyframes[0].offset + 13);
+        uint32_t size = 0xFFFFFFu;
+        file.write(reinterpret_cast<char const*>(&size), sizeof(size));
+    }
+    result = Verify(movie);
+    Expect(!result.ok && result.divergedFrame == 0, "an unreadable keyframe 0 fails at frame 0");
+
+    // a later check still fails where it is, with several keyframes
+    Record(path.c_str(), 500, 100);
+    Movie several;
+    Expect(several.Load(path.c_str()) && several.keyframes.size() == 6, "the movie has a keyframe every 100 frames, the last one included");
+    several.checks[30].hash ^= 1;
+    result = Verify(several);
+    Expect(!result.ok && result.divergedFrame == several.checks[30].frame, "a bad check fails on its frame");
+
+    std::remove(path.c_str());
+    if (failures) {
+        return 1;
+    }
+    std::cout << "movie: ok\n";
+    return 0;
+}
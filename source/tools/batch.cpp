@@ -0,0 +1,507 @@
+#include "../Arena.hpp"
+#include "../Chip8.hpp"
+#include "../FaultLog.hpp"
+#include "../Hash.hpp"
+#include "../Lockstep.hpp"
+#include "../Profile.hpp"
+#include "../RomCache.hpp"
+#include "../WorkStealing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Runs many headless machines on all cores and prints the results as JSON.
+
+    chip8-batch [options] <ROM>...
+
+    Every ROM runs once per seed with no keys held. Jobs are run a slice of frames at a time on a
+    work-stealing pool: after each slice the job queues its next one on the same worker, where
+    an idle worker can steal it, so a few long jobs still spread over every core.
+
+    Machines come from a pool and are Reset between jobs to the job's ROM, which points their
+    memory at the ROM image's shared pages instead of loading anything again.
+    The machines and the pages they copy on write live in one arena (--arena MB, backed by huge
+    pages where possible) rather than on the heap.
+
+    A watchdog ends jobs whose ROM has gone wrong (see Watch), and reports why and at which frame.
+    It leaves the results of every job it doesn't stop on a fault exactly as they would have been.
+
+    Built with CHIP8_PROFILE (make tools PROFILE=1), --profile <prefix> counts every instruction
+    the jobs run into a profile per worker and ROM, merged at the end into <prefix>.folded, the
+    call stacks of all ROMs for a flamegraph, and <prefix>.txt, the opcode and address histograms.
+    The watchdog is off then, the frames it would skip have to be counted too.
+
+    With --engine lockstep, the seeds of each ROM are run in groups of up to 32 on one Lockstep
+    engine instead, one group per task. Lanes that stray from the rest for most of a frame, and the
+    last lane of a group, are handed over to the scalar core as jobs of their own, so seeds that
+    split apart quickly cost about what they would have cost there.
+*/
+
+struct Job {
+    unsigned int rom{};
+    uint64_t seed{};
+
+    Chip8* machine{};
+    uint32_t framesDone{};
+    unsigned int slices{};
+
+    // watchdog: the state being compared against for loops and when it was taken, the number of
+    // frames before it moves on, and what ended the job early
+    uint64_t markHash{};
+    uint32_t markFrame{};
+    uint32_t power{};
+    Chip8::Fault fault{};
+    uint32_t period{};
+    uint32_t stopFrame{};
+
+    uint64_t videoHash{};
+    uint64_t stateHash{};
+    uint64_t instructions{};
+    uint64_t busyNanoseconds{};
+};
+
+// seeds of one ROM run side by side on a lockstep engine
+struct LaneGroup {
+    std::vector<size_t> jobs;
+    std::unique_ptr<Lockstep> engine;
+    uint32_t framesDone{};
+    unsigned int slices{};
+};
+
+// machines not in use by a job, only ever as many as jobs that were running at once
+class InstancePool {
+public:
+    explicit InstancePool(size_t arenaBytes) : arena(arenaBytes) {}
+    ~InstancePool() {
+        for (Chip8* machine : all) {
+            if (arena.Owns(machine)) {
+                arena.Delete(machine);
+            } else {
+                delete machine;
+            }
+        }
+    }
+
+    Chip8* Acquire() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (free.empty()) {
+            // the heap only once the arena is full
+            Chip8* machine = arena.Capacity() ? arena.New<Chip8>(0) : nullptr;
+            all.push_back(machine ? machine : new Chip8(0));
+            all.back()->UseArena(Memory());
+            return all.back();
+        }
+        Chip8* machine = free.back();
+        free.pop_back();
+        return machine;
+    }
+    void Release(Chip8* machine) {
+        std::lock_guard<std::mutex> lock(mutex);
+        free.push_back(machine);
+    }
+    size_t Created() const { return all.size(); }
+    Arena* Memory() { return arena.Capacity() ? &arena : nullptr; }
+
+private:
+    Arena arena;
+    std::mutex mutex;
+    std::vector<Chip8*> all;
+    std::vector<Chip8*> free;
+};
+
+// Called after every frame, returns true if the job has to stop. A fault stops it where it is. A
+// machine back in a state it was in some frames ago will go round that loop for good, as nothing
+// but the frames changes between them, so whole rounds of it are skipped and the job runs only
+// what is left of the last one, which ends it exactly as running them all would have. Loops are
+// found with Brent's algorithm on CycleHash, one hash and compare per frame. The skipped rounds
+// still count as instructions, the same as if they had run.
+static bool Watch(Job& job, uint32_t frames, uint32_t cyclesPerFrame) {
+    if (job.machine->FirstFault() != Chip8::Fault::None) {
+        job.fault = job.machine->FirstFault();
+        job.stopFrame = job.framesDone;
+        return true;
+    }
+    if (job.period) {
+        return false;
+    }
+    uint64_t hash = job.machine->CycleHash();
+    if (hash == job.markHash) {
+        job.period = job.framesDone - job.markFrame;
+        job.stopFrame = job.framesDone;
+        uint32_t resume = frames - (frames - job.framesDone) % job.period;
+        job.instructions += uint64_t(resume - job.framesDone) * cyclesPerFrame;
+        job.framesDone = resume;
+    } else if (job.framesDone - job.markFrame == job.power) {
+        job.markHash = hash;
+        job.markFrame = job.framesDone;
+        job.power *= 2;
+    }
+    return false;
+}
+
+static void PrintUsage(char const* program) {
+    std::cerr << "Usage: " << program << " [options] <ROM>...\n";
+    std::cerr << "  --list <file>      read more ROM paths from a file, one per line\n";
+    std::cerr << "  --seeds <N>        run every ROM with seeds 0 to N-1 (default 1)\n";
+    std::cerr << "  --frames <N>       frames per job (default 600)\n";
+    std::cerr << "  --cycles <N>       cycles per frame (default 10)\n";
+    std::cerr << "  --threads <N>      worker threads (default: all cores)\n";
+    std::cerr << "  --slice <N>        frames run before a job goes back in the queue (default 256)\n";
+    std::cerr << "  --engine <name>    scalar (default) or lockstep, which runs seeds of a ROM side by side\n";
+    std::cerr << "  --lanes <N>        machines per lockstep engine, up to 32 (default 32)\n";
+    std::cerr << "  --arena <MB>       memory reserved for machines, 0 puts them on the heap (default 64)\n";
+    std::cerr << "  --no-watchdog      run every job to the end, faults and loops included (scalar engine)\n";
+    std::cerr << "  --profile <prefix> write <prefix>.folded and <prefix>.txt (scalar engine, needs a PROFILE=1 build),\n";
+    std::cerr << "                     runs every frame as if with --no-watchdog\n";
+    std::exit(EXIT_FAILURE);
+}
+
+static std::string JsonString(std::string const& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+        }
+        quoted += c;
+    }
+    return quoted + "\"";
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> romPaths;
+    uint64_t seeds = 1;
+    uint32_t frames = 600;
+    unsigned int cyclesPerFrame = 10;
+    unsigned int threads = std::thread::hardware_concurrency();
+    uint32_t slice = 256;
+    bool lockstep = false;
+    unsigned int laneCount = LOCKSTEP_LANES_MAX;
+    size_t arenaMegabytes = 64;
+    bool watchdog = true;
+    std::string profilePrefix;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--list" && i + 1 < argc) {
+            std::ifstream list(argv[++i]);
+            if (!list) {
+                std::cerr << "Could not read " << argv[i] << "\n";
+                return EXIT_FAILURE;
+            }
+            for (std::string line; std::getline(list, line);) {
+                if (!line.empty()) {
+                    romPaths.push_back(line);
+                }
+            }
+        } else if (option == "--seeds" && i + 1 < argc) {
+            seeds = std::stoull(argv[++i]);
+        } else if (option == "--frames" && i + 1 < argc) {
+            frames = std::stoul(argv[++i]);
+        } else if (option == "--cycles" && i + 1 < argc) {
+            cyclesPerFrame = std::stoul(argv[++i]);
+        } else if (option == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (option == "--slice" && i + 1 < argc) {
+            slice = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--engine" && i + 1 < argc) {
+            std::string engine = argv[++i];
+            if (engine != "scalar" && engine != "lockstep") {
+                PrintUsage(argv[0]);
+            }
+            lockstep = engine == "lockstep";
+        } else if (option == "--lanes" && i + 1 < argc) {
+            laneCount = std::clamp(std::stoul(argv[++i]), 1ul, (unsigned long)LOCKSTEP_LANES_MAX);
+        } else if (option == "--arena" && i + 1 < argc) {
+            arenaMegabytes = std::stoull(argv[++i]);
+        } else if (option == "--no-watchdog") {
+            watchdog = false;
+        } else if (option == "--profile" && i + 1 < argc) {
+            profilePrefix = argv[++i];
+        } else if (option.starts_with("--")) {
+            PrintUsage(argv[0]);
+        } else {
+            romPaths.push_back(option);
+        }
+    }
+    if (romPaths.empty() || (lockstep && !profilePrefix.empty())) {
+        PrintUsage(argv[0]);
+    }
+    // lockstep lanes can't be watched, and lanes it hands over to the scalar core go on unwatched too;
+    // a profile has to see every frame, and the watchdog skips the rounds of a loop
+    watchdog = watchdog && !lockstep && profilePrefix.empty();
+#ifndef CHIP8_PROFILE
+    if (!profilePrefix.empty()) {
+        std::cerr << "--profile needs a build with CHIP8_PROFILE, make tools PROFILE=1\n";
+        return EXIT_FAILURE;
+    }
+#endif
+
+    // the rest of a long list loads in the background while we wait for the first ones
+    for (std::string const& path : romPaths) {
+        RomCache::Instance().Preload(path);
+    }
+    std::vector<RomHandle> roms;
+    for (std::string const& path : romPaths) {
+        roms.push_back(RomCache::Instance().Get(path));
+        if (!roms.back()) {
+            std::cerr << "Could not read ROM " << path << "\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Job> jobs;
+    for (unsigned int rom = 0; rom < romPaths.size(); ++rom) {
+        for (uint64_t seed = 0; seed < seeds; ++seed) {
+            jobs.push_back({rom, seed});
+        }
+    }
+    threads = threads ? threads : 1;
+
+    // before the workers start so that their misses are counted too
+    TlbMissCounter tlbMisses;
+    InstancePool instances(arenaMegabytes * 1024 * 1024);
+    auto pool = std::make_unique<WorkStealingPool>(threads);
+#ifdef CHIP8_PROFILE
+    // one per worker and ROM, so that nothing is shared while running
+    std::vector<Profile> profiles(profilePrefix.empty() ? 0 : threads * romPaths.size());
+#endif
+
+    std::function<void(size_t, unsigned int)> runSlice = [&](size_t i, unsigned int worker) {
+        auto start = std::chrono::steady_clock::now();
+        Job& job = jobs[i];
+
+        if (!job.machine) {
+            job.machine = instances.Acquire();
+            job.machine->Reset(roms[job.rom]);
+            job.machine->Seed(job.seed);
+            job.markHash = job.machine->CycleHash();
+            job.power = 1;
+        }
+#ifdef CHIP8_PROFILE
+        job.machine->UseProfile(profiles.empty() ? nullptr : &profiles[worker * romPaths.size() + job.rom]);
+#endif
+        uint32_t end = std::min(frames, job.framesDone + slice);
+        bool stopped = false;
+        while (job.framesDone < end && !stopped) {
+            job.machine->RunFrame(cyclesPerFrame);
+            ++job.framesDone;
+            job.instructions += cyclesPerFrame;
+            stopped = watchdog && Watch(job, frames, cyclesPerFrame);
+        }
+        ++job.slices;
+
+        bool finished = stopped || job.framesDone == frames;
+        if (finished) {
+            job.videoHash = HashBytes(job.machine->video, sizeof(job.machine->video));
+            job.stateHash = job.machine->StateHash();
+            instances.Release(job.machine);
+        }
+        job.busyNanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+
+        if (!finished) {
+            pool->Submit(worker, [&runSlice, i](unsigned int worker) { runSlice(i, worker); });
+        }
+    };
+
+    std::vector<LaneGroup> groups;
+    if (lockstep) {
+        // jobs are ROM-major, so consecutive jobs of the same ROM fill a group
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            if (groups.empty() || groups.back().jobs.size() == laneCount || jobs[groups.back().jobs[0]].rom != jobs[i].rom) {
+                groups.emplace_back();
+            }
+            groups.back().jobs.push_back(i);
+        }
+    }
+    std::atomic<uint64_t> vectorSteps{0};
+    std::atomic<uint64_t> scalarSteps{0};
+    std::atomic<uint64_t> splits{0};
+
+    std::function<void(size_t, unsigned int)> runGroupSlice = [&](size_t g, unsigned int worker) {
+        auto start = std::chrono::steady_clock::now();
+        LaneGroup& group = groups[g];
+        Chip8 machine(0);
+        machine.Reset(roms[jobs[group.jobs[0]].rom]);
+
+        if (!group.engine) {
+            group.engine = std::make_unique<Lockstep>(group.jobs.size());
+            for (unsigned int lane = 0; lane < group.jobs.size(); ++lane) {
+                machine.Seed(jobs[group.jobs[lane]].seed);
+                group.engine->Load(lane, machine);
+            }
+        }
+        uint32_t end = std::min(frames, group.framesDone + slice);
+        while (group.framesDone < end && !group.jobs.empty()) {
+            Lockstep& engine = *group.engine;
+            engine.RunFrame(cyclesPerFrame);
+            ++group.framesDone;
+
+            // lanes that went their own way, and the last one, run on faster as jobs of their own
+            for (unsigned int lane = engine.Lanes(); lane-- > 0 && group.framesDone < frames;) {
+                if (engine.Lanes() > 1 && engine.Strays(lane) * 2 <= cyclesPerFrame) {
+                    continue;
+                }
+                size_t i = group.jobs[lane];
+                Job& job = jobs[i];
+                job.machine = instances.Acquire();
+                job.machine->Reset(roms[job.rom]);
+                engine.Store(lane, *job.machine);
+                job.framesDone = group.framesDone;
+                job.instructions = uint64_t(group.framesDone) * cyclesPerFrame;
+                job.slices = group.slices + 1;
+                ++splits;
+
+                engine.Remove(lane);
+                group.jobs[lane] = group.jobs.back();
+                group.jobs.pop_back();
+                pool->Submit(worker, [&runSlice, i](unsigned int worker) { runSlice(i, worker); });
+            }
+            engine.ClearStrays();
+        }
+        ++group.slices;
+
+        bool finished = group.framesDone == frames || group.jobs.empty();
+        if (finished) {
+            for (unsigned int lane = 0; lane < group.jobs.size(); ++lane) {
+                Job& job = jobs[group.jobs[lane]];
+                group.engine->Store(lane, machine);
+                job.videoHash = HashBytes(group.engine->Video(lane), sizeof(machine.video));
+                job.stateHash = machine.StateHash();
+                job.instructions = uint64_t(frames) * cyclesPerFrame;
+                job.slices = group.slices;
+            }
+            vectorSteps += group.engine->VectorSteps();
+            scalarSteps += group.engine->ScalarSteps();
+            group.engine.reset();
+        }
+
+        // the lanes shared the time
+        uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        for (size_t i : group.jobs) {
+            jobs[i].busyNanoseconds += ns / group.jobs.size();
+        }
+
+        if (!finished) {
+            pool->Submit(worker, [&runGroupSlice, g](unsigned int worker) { runGroupSlice(g, worker); });
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    if (lockstep) {
+        for (size_t g = 0; g < groups.size(); ++g) {
+            pool->Submit([&runGroupSlice, g](unsigned int worker) { runGroupSlice(g, worker); });
+        }
+    } else {
+        for (size_t i = 0; i < jobs.size(); ++i) {
+            pool->Submit([&runSlice, i](unsigned int worker) { runSlice(i, worker); });
+        }
+    }
+    pool->Wait();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+#ifdef CHIP8_PROFILE
+    if (!profiles.empty()) {
+        std::ofstream folded(profilePrefix + ".folded");
+        std::ofstream report(profilePrefix + ".txt");
+        for (unsigned int rom = 0; rom < romPaths.size(); ++rom) {
+            Profile& merged = profiles[rom];
+            for (unsigned int worker = 1; worker < threads; ++worker) {
+                merged.Merge(profiles[worker * romPaths.size() + rom]);
+            }
+            // flamegraph tools split frames on ';' and the count on the last space
+            std::string root = romPaths[rom].substr(romPaths[rom].find_last_of("/\\") + 1);
+            std::replace(root.begin(), root.end(), ';', '_');
+            std::replace(root.begin(), root.end(), ' ', '_');
+            merged.WriteCollapsed(folded, root);
+            report << (rom ? "\n" : "") << "== " << romPaths[rom] << ": " << merged.Instructions() << " instructions\n";
+            merged.WriteReport(report, 32);
+        }
+        if (!folded || !report) {
+            std::cerr << "Could not write the profile to " << profilePrefix << ".folded/.txt\n";
+        }
+    }
+#endif
+
+    // workers' counts only reach the counter once their threads have exited
+    std::vector<WorkStealingPool::WorkerStats> stats = pool->Stats();
+    pool.reset();
+
+    uint64_t instructions = 0;
+    uint64_t faulted = 0;
+    uint64_t looped = 0;
+    std::printf("{\n  \"jobs\": [\n");
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        Job const& job = jobs[i];
+        instructions += job.instructions;
+
+        // why the watchdog ended the job early, a loop still leaves the results of the full run
+        char stop[96] = "null";
+        if (job.fault != Chip8::Fault::None) {
+            ++faulted;
+            std::snprintf(stop, sizeof(stop), "{\"reason\": \"%s\", \"frame\": %u}", Chip8::FaultName(job.fault), job.stopFrame);
+        } else if (job.period) {
+            ++looped;
+            std::snprintf(stop, sizeof(stop), "{\"reason\": \"loop\", \"frame\": %u, \"period\": %u}", job.stopFrame, job.period);
+        }
+        std::printf("    {\"rom\": %s, \"seed\": %llu, \"videoHash\": \"%016llx\", \"stateHash\": \"%016llx\", "
+            "\"instructions\": %llu, \"slices\": %u, \"ms\": %.3f, \"stop\": %s}%s\n",
+            JsonString(romPaths[job.rom]).c_str(), (unsigned long long)job.seed,
+            (unsigned long long)job.videoHash, (unsigned long long)job.stateHash, (unsigned long long)job.instructions,
+            job.slices, job.busyNanoseconds / 1e6, stop, i + 1 < jobs.size() ? "," : "");
+    }
+    std::printf("  ],\n");
+
+    // busy time over wall time, idle workers mean the jobs couldn't be spread evenly
+    std::printf("  \"workers\": [\n");
+    for (size_t i = 0; i < stats.size(); ++i) {
+        std::printf("    {\"tasks\": %llu, \"steals\": %llu, \"utilization\": %.3f}%s\n",
+            (unsigned long long)stats[i].tasks, (unsigned long long)stats[i].steals,
+            seconds > 0 ? stats[i].busyNanoseconds / 1e9 / seconds : 0.0, i + 1 < stats.size() ? "," : "");
+    }
+    std::printf("  ],\n");
+    if (lockstep) {
+        // share of lane instructions that ran across lanes rather than one lane at a time
+        uint64_t steps = vectorSteps + scalarSteps;
+        std::printf("  \"engine\": \"lockstep\",\n  \"groups\": %zu,\n  \"vectorShare\": %.3f,\n  \"splits\": %llu,\n",
+            groups.size(), steps ? double(vectorSteps) / steps : 0.0, (unsigned long long)splits.load());
+    } else {
+        std::printf("  \"engine\": \"scalar\",\n  \"instances\": %zu,\n", instances.Created());
+        // everything the machines allocated, their copied pages included
+        if (Arena* arena = instances.Memory()) {
+            double megabytes = arena->Used() / (1024.0 * 1024.0);
+            std::printf("  \"arena\": {\"backing\": \"%s\", \"megabytes\": %.3f, \"instancesPerMB\": %.1f},\n",
+                arena->Backing(), megabytes, megabytes > 0 ? instances.Created() / megabytes : 0.0);
+        } else {
+            std::printf("  \"arena\": null,\n");
+        }
+    }
+    if (tlbMisses.Available()) {
+        std::printf("  \"dtlbMisses\": %llu,\n", (unsigned long long)tlbMisses.Read());
+    } else {
+        std::printf("  \"dtlbMisses\": null,\n");
+    }
+    if (watchdog) {
+        std::printf("  \"watchdog\": {\"faulted\": %llu, \"looped\": %llu},\n", (unsigned long long)faulted, (unsigned long long)looped);
+    } else {
+        std::printf("  \"watchdog\": null,\n");
+    }
+    // the faults themselves go to stderr, rate limited
+    FaultLog::Stats faultLog = FaultLog::Instance().GetStats();
+    FaultLog::Instance().Drain(std::cerr);
+    std::printf("  \"faults\": {\"recorded\": %llu, \"logged\": %llu, \"dropped\": %llu},\n",
+        (unsigned long long)faultLog.recorded, (unsigned long long)faultLog.logged, (unsigned long long)faultLog.dropped);
+    std::printf("  \"threads\": %u,\n  \"frames\": %u,\n  \"cyclesPerFrame\": %u,\n", threads, frames, cyclesPerFrame);
+    std::printf("  \"instructions\": %llu,\n  \"seconds\": %.6f,\n  \"instructionsPerSecond\": %.0f\n}\n",
+        (unsigned long long)instructions, seconds, seconds > 0 ? instructions / seconds : 0.0);
+    return 0;
+}
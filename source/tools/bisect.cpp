@@ -0,0 +1,283 @@
+#include "../Chip8.hpp"
+#include "../Movie.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+/*
+    Finds where two builds of the core stop agreeing on a replay.
+
+    chip8-bisect <ROM> <A> <B>  compares two recordings of the same inputs made by two builds
+                                (chip8-replay --rerecord with the same intervals on each build)
+    chip8-bisect <ROM> <A>      compares this build against a recording made by another one
+
+    The first diverging keyframe is found by binary search on state hashes, then the first diverging
+    hash check inside that segment. The frames between the last agreeing check and the first diverging
+    one are stepped one instruction at a time with this build, and the full states of both sides at
+    the first diverging check are diffed, which needs a keyframe there.
+*/
+
+// instructions printed while stepping, a runaway diverging frame shouldn't flood the terminal
+const unsigned int STEP_PRINT_MAX = 2000;
+const unsigned int MEMORY_DIFF_PRINT_MAX = 64;
+
+static bool LoadKeyframe(Movie const& movie, int keyframe, Chip8& chip8) {
+    std::vector<uint8_t> blob;
+    return movie.ReadKeyframe(keyframe, blob) && chip8.LoadState(blob);
+}
+
+// this build's state at a frame, replayed from a keyframe before it
+static void ReplayTo(Movie const& movie, int keyframe, uint32_t to, Chip8& chip8) {
+    LoadKeyframe(movie, keyframe, chip8);
+    for (uint32_t frame = movie.keyframes[keyframe].frame; frame < to; ++frame) {
+        chip8.SetKeys(movie.KeysAt(frame));
+        chip8.RunFrame(movie.cyclesPerFrame);
+    }
+}
+
+// a recording's own state at a frame, which it only has where there is a keyframe
+static bool KeyframeAt(Movie const& movie, uint32_t frame, Chip8& chip8) {
+    auto keyframe = std::lower_bound(movie.keyframes.begin(), movie.keyframes.end(), frame,
+        [](Movie::Keyframe const& keyframe, uint32_t frame) { return keyframe.frame < frame; });
+    return keyframe != movie.keyframes.end() && keyframe->frame == frame &&
+        LoadKeyframe(movie, int(keyframe - movie.keyframes.begin()), chip8);
+}
+
+static bool CheckAt(Movie const& movie, uint32_t frame, uint64_t& hash) {
+    auto check = std::lower_bound(movie.checks.begin(), movie.checks.end(), frame,
+        [](Movie::Check const& check, uint32_t frame) { return check.frame < frame; });
+    if (check == movie.checks.end() || check->frame != frame) {
+        return false;
+    }
+    hash = check->hash;
+    return true;
+}
+
+static void PrintStateDiff(Chip8::Snapshot const& a, Chip8::Snapshot const& b, char const* nameA, char const* nameB) {
+    std::printf("state diff (%s / %s):\n", nameA, nameB);
+
+    for (unsigned int i = 0; i < REGISTER_COUNT; ++i) {
+        if (a.registers[i] != b.registers[i]) {
+            std::printf("  V%X     %02X / %02X\n", i, a.registers[i], b.registers[i]);
+        }
+    }
+    if (a.index != b.index) std::printf("  I      %03X / %03X\n", a.index, b.index);
+    if (a.pc != b.pc) std::printf("  PC     %03X / %03X\n", a.pc, b.pc);
+    if (a.sp != b.sp) std::printf("  SP     %X / %X\n", a.sp, b.sp);
+    if (a.delayTimer != b.delayTimer) std::printf("  DT     %02X / %02X\n", a.delayTimer, b.delayTimer);
+    if (a.soundTimer != b.soundTimer) std::printf("  ST     %02X / %02X\n", a.soundTimer, b.soundTimer);
+    for (unsigned int i = 0; i < STACK_LEVELS; ++i) {
+        if (a.stack[i] != b.stack[i]) {
+            std::printf("  S[%X]   %03X / %03X\n", i, a.stack[i], b.stack[i]);
+        }
+    }
+    if (memcmp(a.rng.state, b.rng.state, sizeof(a.rng.state)) != 0) {
+        std::printf("  RNG    differs\n");
+    }
+
+    unsigned int memoryDiffs = 0;
+    for (unsigned int address = 0; address < MEMORY_SIZE; ++address) {
+        if (a.memory[address] != b.memory[address] && memoryDiffs++ < MEMORY_DIFF_PRINT_MAX) {
+            std::printf("  [%03X]  %02X / %02X\n", address, a.memory[address], b.memory[address]);
+        }
+    }
+    if (memoryDiffs > MEMORY_DIFF_PRINT_MAX) {
+        std::printf("  ... %u memory bytes differ in total\n", memoryDiffs);
+    }
+
+    if (memcmp(a.video, b.video, sizeof(a.video)) != 0) {
+        // '#' on in both, 'a' only in the first, 'b' only in the second
+        std::printf("  display:\n");
+        for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y) {
+            std::string line;
+            for (unsigned int x = 0; x < VIDEO_WIDTH; ++x) {
+                bool onA = (a.video[y] >> (VIDEO_WIDTH - 1 - x)) & 1u;
+                bool onB = (b.video[y] >> (VIDEO_WIDTH - 1 - x)) & 1u;
+                line += onA && onB ? '#' : onA ? 'a' : onB ? 'b' : '.';
+            }
+            std::printf("  %s\n", line.c_str());
+        }
+    }
+}
+
+// Steps this build through frames [from, to) one instruction at a time, starting from the given
+// keyframe, and reports which recording each frame's state agrees with.
+static void StepFrames(Movie const& movie, Movie const* other, int keyframe, uint32_t from, uint32_t to, Chip8& chip8) {
+    ReplayTo(movie, keyframe, from, chip8);
+
+    unsigned int printed = 0;
+    Chip8::Snapshot before{};
+    Chip8::Snapshot after{};
+
+    for (uint32_t frame = from; frame < to; ++frame) {
+        chip8.SetKeys(movie.KeysAt(frame));
+
+        for (uint32_t cycle = 0; cycle < movie.cyclesPerFrame; ++cycle) {
+            chip8.Capture(before);
+            chip8.Cycle();
+            chip8.Capture(after);
+
+            if (printed++ >= STEP_PRINT_MAX) {
+                continue;
+            }
+            uint16_t opcode = before.memory[before.pc % MEMORY_SIZE] << 8u | before.memory[(before.pc + 1) % MEMORY_SIZE];
+            std::printf("  frame %u cycle %u  %03X: %04X ", frame, cycle, before.pc, opcode);
+            for (unsigned int i = 0; i < REGISTER_COUNT; ++i) {
+                if (before.registers[i] != after.registers[i]) {
+                    std::printf(" V%X=%02X", i, after.registers[i]);
+                }
+            }
+            if (before.index != after.index) std::printf(" I=%03X", after.index);
+            if (before.sp != after.sp) std::printf(" SP=%X", after.sp);
+            if (memcmp(before.memory, after.memory, MEMORY_SIZE) != 0) std::printf(" (memory write)");
+            if (memcmp(before.video, after.video, sizeof(before.video)) != 0) std::printf(" (draw)");
+            std::printf("\n");
+        }
+
+        uint64_t local = chip8.StateHash();
+        uint64_t hashA = 0;
+        uint64_t hashB = 0;
+        bool hasA = CheckAt(movie, frame + 1, hashA);
+        bool hasB = other && CheckAt(*other, frame + 1, hashB);
+        std::printf("  after frame %u: this build %016llx", frame + 1, (unsigned long long)local);
+        if (hasA) std::printf(", A %016llx%s", (unsigned long long)hashA, local == hashA ? " (same)" : "");
+        if (hasB) std::printf(", B %016llx%s", (unsigned long long)hashB, local == hashB ? " (same)" : "");
+        std::printf("\n");
+    }
+    if (printed > STEP_PRINT_MAX) {
+        std::printf("  ... %u more instructions not shown\n", printed - STEP_PRINT_MAX);
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc != 3 && argc != 4){
+
+		std::cerr << "Usage: " << argv[0] << " <ROM> <Movie A> [<Movie B>]\n";
+		std::exit(EXIT_FAILURE);
+
+	}
+
+    Movie a;
+    Movie b;
+    bool twoMovies = argc == 4;
+    if (!a.Load(argv[2]) || (twoMovies && !b.Load(argv[3]))) {
+        std::cerr << "Could not read movies\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (a.keyframes.empty()) {
+        std::cerr << "Movie has no keyframes, re-record it with chip8-replay --rerecord\n";
+        std::exit(EXIT_FAILURE);
+    }
+    if (twoMovies && (a.romHash != b.romHash || a.seed != b.seed || a.cyclesPerFrame != b.cyclesPerFrame ||
+        a.frameCount != b.frameCount || a.keyframeInterval != b.keyframeInterval || a.hashInterval != b.hashInterval)) {
+        std::cerr << "Movies don't come from the same inputs and intervals, re-record both with the same options\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    Chip8 chip8;
+    chip8.LoadROM(argv[1]);
+    if (chip8.RomHash() != a.romHash) {
+        std::cerr << "ROM doesn't match the movie\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    // does the other side agree with A at keyframe k? both are known to agree at lo
+    Chip8 probe = chip8.Clone();
+    unsigned int probes = 0;
+    auto keyframeAgrees = [&](int lo, int k) {
+        ++probes;
+        if (twoMovies) {
+            return a.keyframes[k].hash == b.keyframes[k].hash;
+        }
+        ReplayTo(a, lo, a.keyframes[k].frame, probe);
+        return probe.StateHash() == a.keyframes[k].hash;
+    };
+
+    // keyframe 0 is the power-on state, which both sides start from
+    int lo = 0;
+    int hi = int(a.keyframes.size());
+    if (!twoMovies || a.keyframes[0].hash == b.keyframes[0].hash) {
+        while (hi - lo > 1) {
+            int mid = (lo + hi) / 2;
+            if (keyframeAgrees(lo, mid)) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+    } else {
+        // nothing ran yet, the builds disagree on loading the ROM or seeding the machine
+        Chip8::Snapshot stateA{};
+        Chip8::Snapshot stateB{};
+        Chip8 other = chip8.Clone();
+        LoadKeyframe(a, 0, probe);
+        LoadKeyframe(b, 0, other);
+        probe.Capture(stateA);
+        other.Capture(stateB);
+        std::printf("power-on states already differ, ");
+        PrintStateDiff(stateA, stateB, "A", "B");
+        return 1;
+    }
+
+    uint32_t segmentEnd = hi < int(a.keyframes.size()) ? a.keyframes[hi].frame : a.frameCount;
+    std::printf("%u probes: last agreeing keyframe at frame %u, segment ends at frame %u\n",
+        probes, a.keyframes[lo].frame, segmentEnd);
+
+    // first diverging hash check inside the segment, replaying this build when there is no second movie
+    uint32_t lastGood = a.keyframes[lo].frame;
+    uint32_t firstBad = 0;
+    LoadKeyframe(a, lo, probe);
+    for (uint32_t frame = lastGood; frame < segmentEnd && !firstBad; ++frame) {
+        uint64_t hashA = 0;
+        uint64_t hashB = 0;
+        if (!twoMovies) {
+            probe.SetKeys(a.KeysAt(frame));
+            probe.RunFrame(a.cyclesPerFrame);
+            hashB = probe.StateHash();
+        }
+        if (!CheckAt(a, frame + 1, hashA) || (twoMovies && !CheckAt(b, frame + 1, hashB))) {
+            continue;
+        }
+        if (hashA == hashB) {
+            lastGood = frame + 1;
+        } else {
+            firstBad = frame + 1;
+        }
+    }
+
+    if (!firstBad) {
+        if (hi == int(a.keyframes.size())) {
+            std::printf("no divergence found in %u frames\n", a.frameCount);
+            return 0;
+        }
+        // no checks inside the segment, the keyframe at its end is the first known difference
+        firstBad = segmentEnd;
+    }
+
+    std::printf("first divergence after frame %u, at or before frame %u\n", lastGood, firstBad);
+    std::printf("stepping this build through frames %u..%u:\n", lastGood, firstBad - 1);
+    StepFrames(a, twoMovies ? &b : nullptr, lo, lastGood, firstBad, probe);
+
+    // full states of both sides where they first differ, a recording only has them at its keyframes
+    Chip8 sideA = chip8.Clone();
+    Chip8 sideB = chip8.Clone();
+    if (!twoMovies) {
+        ReplayTo(a, lo, firstBad, sideB);
+    }
+    if (!KeyframeAt(a, firstBad, sideA) || (twoMovies && !KeyframeAt(b, firstBad, sideB))) {
+        std::printf("no keyframe at frame %u to diff the states, re-record with --keyframe-interval %u for one\n",
+            firstBad, firstBad);
+        return 1;
+    }
+
+    Chip8::Snapshot stateA{};
+    Chip8::Snapshot stateB{};
+    sideA.Capture(stateA);
+    sideB.Capture(stateB);
+    std::printf("at frame %u, ", firstBad);
+    PrintStateDiff(stateA, stateB, "A", twoMovies ? "B" : "this build");
+
+    return 1;
+}
@@ -0,0 +1,270 @@
+#include "../Chip8.hpp"
+#include "../Hash.hpp"
+#include "../RomCache.hpp"
+#include "../StateFile.hpp"
+#include "../WorkStealing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+/*
+    Explores the states a ROM can reach from a start state, breadth first on all cores, and prints
+    the distinct screens it found with the shortest input sequence reaching each as JSON.
+
+    chip8-explore [options] <ROM>
+
+    Every state branches 17 ways: no key, or one of the 16 keys held for a step of --step frames.
+    A step ends early when the machine stops on Fx0A for a key, and a state waiting for a key
+    doesn't branch on no key. States are told apart by CycleHash (memory, registers, timers,
+    stack, screen and the RNG) and each is expanded once. Two states that differ only in the RNG
+    go on differently at the next Cxkk, so both are kept; the RNG only moves on Cxkk, so ROMs
+    that never use it see no more states than without it. A state whose program has halted on a
+    jump to itself isn't expanded at all.
+
+    Levels are expanded in parallel against the states seen in earlier levels, then merged in
+    order of (parent, input), so the result doesn't depend on the number of threads. Only the
+    hashes are kept while expanding; the children that turn out to be new are run again from
+    their parents, which keeps memory at one machine per state of the frontier.
+*/
+
+const unsigned int BRANCHES = KEY_COUNT + 1;
+
+// how a state was first reached: from which state of the previous level, and with which input
+struct Node {
+    uint32_t parent;
+    uint8_t input;
+};
+
+struct Candidate {
+    uint32_t parent;
+    uint8_t input;
+    uint64_t hash;
+};
+
+struct Screen {
+    uint64_t hash;
+    unsigned int level;
+    uint32_t node;
+    uint64_t video[VIDEO_HEIGHT];
+};
+
+static void PrintUsage(char const* program) {
+    std::cerr << "Usage: " << program << " [options] <ROM>\n";
+    std::cerr << "  --state <file>     start from a savestate instead of power-on\n";
+    std::cerr << "  --seed <N>         RNG seed (default 0)\n";
+    std::cerr << "  --step <N>         frames every input is held for (default 10)\n";
+    std::cerr << "  --cycles <N>       cycles per frame (default 10)\n";
+    std::cerr << "  --depth <N>        inputs to explore at most (default 12)\n";
+    std::cerr << "  --max-states <N>   stop after this many distinct states (default 200000)\n";
+    std::cerr << "  --threads <N>      worker threads (default: all cores)\n";
+    std::cerr << "  --screens <dir>    also write every screen found there as a PBM image\n";
+    std::exit(EXIT_FAILURE);
+}
+
+// holds the input for a step, stopping early where the program asks for a key as that is where
+// the next input matters
+static Chip8 Advance(Chip8 const& parent, uint8_t input, unsigned int step, unsigned int cyclesPerFrame) {
+    Chip8 child = parent.Clone();
+    child.SetKeys(input ? uint16_t(1u << (input - 1)) : 0);
+    for (unsigned int frame = 0; frame < step; ++frame) {
+        child.RunFrame(cyclesPerFrame);
+        if (frame + 1 < step && input == 0 && child.WaitingForKey()) {
+            break;
+        }
+    }
+    return child;
+}
+
+// '-' for no key, the key's hex digit otherwise
+static char InputName(uint8_t input) {
+    return input == 0 ? '-' : "0123456789ABCDEF"[input - 1];
+}
+
+static void WritePbm(std::string const& path, uint64_t const* video) {
+    std::ofstream file(path, std::ios::binary);
+    file << "P4\n" << VIDEO_WIDTH << " " << VIDEO_HEIGHT << "\n";
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y) {
+        for (int shift = VIDEO_WIDTH - 8; shift >= 0; shift -= 8) {
+            file.put(char((video[y] >> shift) & 0xFFu));
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string romPath;
+    char const* statePath = nullptr;
+    uint64_t seed = 0;
+    unsigned int step = 10;
+    unsigned int cyclesPerFrame = 10;
+    unsigned int depth = 12;
+    size_t maxStates = 200000;
+    unsigned int threads = std::thread::hardware_concurrency();
+    std::string screensDir;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--state" && i + 1 < argc) {
+            statePath = argv[++i];
+        } else if (option == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else if (option == "--step" && i + 1 < argc) {
+            step = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--cycles" && i + 1 < argc) {
+            cyclesPerFrame = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--depth" && i + 1 < argc) {
+            depth = std::stoul(argv[++i]);
+        } else if (option == "--max-states" && i + 1 < argc) {
+            maxStates = std::stoull(argv[++i]);
+        } else if (option == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (option == "--screens" && i + 1 < argc) {
+            screensDir = argv[++i];
+        } else if (option.starts_with("--") || !romPath.empty()) {
+            PrintUsage(argv[0]);
+        } else {
+            romPath = option;
+        }
+    }
+    if (romPath.empty()) {
+        PrintUsage(argv[0]);
+    }
+
+    RomHandle rom = RomCache::Instance().Get(romPath);
+    if (!rom) {
+        std::cerr << "Could not read ROM " << romPath << "\n";
+        return EXIT_FAILURE;
+    }
+    Chip8 start(seed);
+    start.Reset(rom);
+    if (statePath) {
+        std::vector<uint8_t> blob;
+        if (!ReadStateFile(statePath, blob) || !start.LoadState(blob)) {
+            std::cerr << "Could not load savestate " << statePath << " for this ROM\n";
+            return EXIT_FAILURE;
+        }
+    }
+    threads = threads ? threads : 1;
+
+    std::unordered_set<uint64_t> seen{start.CycleHash()};
+    std::vector<std::vector<Node>> levels{{{0, 0}}};
+    std::vector<Chip8> frontier{start};
+
+    std::unordered_map<uint64_t, size_t> screenIndex;
+    std::vector<Screen> screens;
+    auto addScreen = [&](Chip8 const& machine, unsigned int level, uint32_t node) {
+        uint64_t hash = HashBytes(machine.video, sizeof(machine.video));
+        if (screenIndex.try_emplace(hash, screens.size()).second) {
+            Screen screen{hash, level, node, {}};
+            std::copy(std::begin(machine.video), std::end(machine.video), screen.video);
+            screens.push_back(screen);
+        }
+    };
+    addScreen(start, 0, 0);
+
+    WorkStealingPool pool(threads);
+    uint64_t halted = 0;
+    uint64_t expanded = 0;
+    auto startTime = std::chrono::steady_clock::now();
+
+    while (!frontier.empty() && levels.size() <= depth && seen.size() < maxStates) {
+        // every worker collects the children it finds new, checked against earlier levels only
+        std::vector<std::vector<Candidate>> found(pool.Threads());
+        std::atomic<uint64_t> haltedHere{0};
+        size_t chunk = std::max<size_t>(1, frontier.size() / (pool.Threads() * 8));
+        for (size_t first = 0; first < frontier.size(); first += chunk) {
+            size_t last = std::min(frontier.size(), first + chunk);
+            pool.Submit([&, first, last](unsigned int worker) {
+                for (size_t parent = first; parent < last; ++parent) {
+                    Chip8 const& machine = frontier[parent];
+                    if (machine.Halted()) {
+                        ++haltedHere;
+                        continue;
+                    }
+                    bool waiting = machine.WaitingForKey();
+                    for (uint8_t input = waiting ? 1 : 0; input < BRANCHES; ++input) {
+                        uint64_t hash = Advance(machine, input, step, cyclesPerFrame).CycleHash();
+                        if (!seen.contains(hash)) {
+                            found[worker].push_back({uint32_t(parent), input, hash});
+                        }
+                    }
+                }
+            });
+        }
+        pool.Wait();
+        halted += haltedHere;
+        expanded += frontier.size();
+
+        std::vector<Candidate> candidates;
+        for (auto& list : found) {
+            candidates.insert(candidates.end(), list.begin(), list.end());
+        }
+        std::sort(candidates.begin(), candidates.end(), [](Candidate const& a, Candidate const& b) {
+            return a.parent != b.parent ? a.parent < b.parent : a.input < b.input;
+        });
+
+        std::vector<Node> level;
+        for (Candidate const& candidate : candidates) {
+            if (seen.size() >= maxStates || !seen.insert(candidate.hash).second) {
+                continue;
+            }
+            level.push_back({candidate.parent, candidate.input});
+        }
+        if (level.empty()) {
+            break;
+        }
+
+        std::vector<Chip8> next(level.size(), Chip8(0));
+        for (size_t first = 0; first < level.size(); first += chunk) {
+            size_t last = std::min(level.size(), first + chunk);
+            pool.Submit([&, first, last](unsigned int) {
+                for (size_t i = first; i < last; ++i) {
+                    next[i] = Advance(frontier[level[i].parent], level[i].input, step, cyclesPerFrame);
+                }
+            });
+        }
+        pool.Wait();
+        for (size_t i = 0; i < next.size(); ++i) {
+            addScreen(next[i], unsigned(levels.size()), uint32_t(i));
+        }
+        levels.push_back(std::move(level));
+        frontier = std::move(next);
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    std::printf("{\n  \"rom\": \"%016llx\",\n  \"states\": %zu,\n  \"expanded\": %llu,\n  \"halted\": %llu,\n  \"depth\": %zu,\n",
+        (unsigned long long)start.RomHash(), seen.size(), (unsigned long long)expanded, (unsigned long long)halted, levels.size() - 1);
+    std::printf("  \"statesPerLevel\": [");
+    for (size_t i = 0; i < levels.size(); ++i) {
+        std::printf("%s%zu", i ? ", " : "", levels[i].size());
+    }
+    std::printf("],\n  \"seconds\": %.3f,\n  \"screens\": [\n", seconds);
+    for (size_t i = 0; i < screens.size(); ++i) {
+        Screen const& screen = screens[i];
+        // walk back up to the start state for the inputs, then print them in order
+        std::string inputs;
+        uint32_t node = screen.node;
+        for (unsigned int level = screen.level; level > 0; --level) {
+            inputs += InputName(levels[level][node].input);
+            node = levels[level][node].parent;
+        }
+        std::reverse(inputs.begin(), inputs.end());
+        std::printf("    {\"video\": \"%016llx\", \"depth\": %u, \"inputs\": \"%s\"}%s\n",
+            (unsigned long long)screen.hash, screen.level, inputs.c_str(), i + 1 < screens.size() ? "," : "");
+
+        if (!screensDir.empty()) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "/%016llx.pbm", (unsigned long long)screen.hash);
+            WritePbm(screensDir + name, screen.video);
+        }
+    }
+    std::printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,154 @@
+#include "../Chip8.hpp"
+#include "../RomCache.hpp"
+#include "../SessionHost.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+    Hosts many sessions of one ROM in real time on a few threads, with simulated players pressing
+    keys, and prints how the host kept up as JSON.
+
+    chip8-host [options] <ROM>
+
+    Every session starts from power-on with its own seed. Players press a random key on a random
+    session every so often and let go a few frames later. Sessions sitting on an idle machine
+    (waiting for a key, or for the delay timer) sleep instead of running frames. With --verify
+    every session is replayed afterwards from the keys it saw and has to end in the same state.
+*/
+
+static void PrintUsage(char const* program) {
+    std::cerr << "Usage: " << program << " [options] <ROM>\n";
+    std::cerr << "  --sessions <N>     sessions to host (default 1000)\n";
+    std::cerr << "  --seconds <N>      how long to run them (default 5)\n";
+    std::cerr << "  --threads <N>      worker threads (default: all cores)\n";
+    std::cerr << "  --cycles <N>       cycles per frame (default 10)\n";
+    std::cerr << "  --hz <N>           frames per second of every session (default 60)\n";
+    std::cerr << "  --presses <R>      key presses per session per second (default 0.5)\n";
+    std::cerr << "  --verify           replay every session afterwards and compare\n";
+    std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    std::string romPath;
+    unsigned int sessionCount = 1000;
+    double seconds = 5;
+    unsigned int threads = std::thread::hardware_concurrency();
+    unsigned int cyclesPerFrame = 10;
+    unsigned int hz = 60;
+    double presses = 0.5;
+    bool verify = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--sessions" && i + 1 < argc) {
+            sessionCount = std::stoul(argv[++i]);
+        } else if (option == "--seconds" && i + 1 < argc) {
+            seconds = std::stod(argv[++i]);
+        } else if (option == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (option == "--cycles" && i + 1 < argc) {
+            cyclesPerFrame = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--hz" && i + 1 < argc) {
+            hz = std::max(1ul, std::stoul(argv[++i]));
+        } else if (option == "--presses" && i + 1 < argc) {
+            presses = std::stod(argv[++i]);
+        } else if (option == "--verify") {
+            verify = true;
+        } else if (option.starts_with("--") || !romPath.empty()) {
+            PrintUsage(argv[0]);
+        } else {
+            romPath = option;
+        }
+    }
+    if (romPath.empty()) {
+        PrintUsage(argv[0]);
+    }
+    RomHandle rom = RomCache::Instance().Get(romPath);
+    if (!rom) {
+        std::cerr << "Could not read ROM " << romPath << "\n";
+        return EXIT_FAILURE;
+    }
+    threads = threads ? threads : 1;
+
+    auto period = std::chrono::duration_cast<SessionHost::Clock::duration>(std::chrono::duration<double>(1.0 / hz));
+    SessionHost host(threads, cyclesPerFrame, period);
+
+    Chip8 machine(0);
+    machine.Reset(rom);
+    for (unsigned int i = 0; i < sessionCount; ++i) {
+        machine.Seed(i);
+        host.Open(machine);
+    }
+
+    // the players: presses arrive at random, each key is let go 6 frames later
+    struct Release {
+        SessionHost::Clock::time_point when;
+        unsigned int session;
+    };
+    std::vector<Release> releases;
+    std::mt19937_64 random(1);
+    auto start = SessionHost::Clock::now();
+    auto end = start + std::chrono::duration_cast<SessionHost::Clock::duration>(std::chrono::duration<double>(seconds));
+    auto tick = std::chrono::milliseconds(1);
+    double due = 0;
+    uint64_t pressed = 0;
+
+    for (auto now = start; now < end; now = SessionHost::Clock::now()) {
+        for (due += presses * sessionCount * std::chrono::duration<double>(tick).count(); due >= 1 && sessionCount; --due) {
+            unsigned int session = unsigned(random() % sessionCount);
+            host.SetKeys(session, uint16_t(1u << (random() % KEY_COUNT)));
+            releases.push_back({now + period * 6, session});
+            ++pressed;
+        }
+        auto released = std::partition(releases.begin(), releases.end(), [now](Release const& r) { return r.when > now; });
+        for (auto r = released; r != releases.end(); ++r) {
+            host.SetKeys(r->session, 0);
+        }
+        releases.erase(released, releases.end());
+        std::this_thread::sleep_for(tick);
+    }
+    host.Stop();
+    double elapsed = std::chrono::duration<double>(SessionHost::Clock::now() - start).count();
+
+    SessionHost::Stats stats = host.GetStats();
+    uint64_t frames = stats.framesRun + stats.framesSkipped;
+    std::printf("{\n  \"sessions\": %u,\n  \"threads\": %u,\n  \"hz\": %u,\n  \"cyclesPerFrame\": %u,\n  \"seconds\": %.3f,\n",
+        sessionCount, threads, hz, cyclesPerFrame, elapsed);
+    std::printf("  \"presses\": %llu,\n  \"framesRun\": %llu,\n  \"framesSkipped\": %llu,\n  \"idleShare\": %.3f,\n",
+        (unsigned long long)pressed, (unsigned long long)stats.framesRun, (unsigned long long)stats.framesSkipped,
+        frames ? double(stats.framesSkipped) / frames : 0.0);
+    std::printf("  \"wakeups\": %llu,\n  \"lateFrames\": %llu,\n  \"meanLatenessMs\": %.3f,\n  \"worstLatenessMs\": %.3f",
+        (unsigned long long)stats.wakeups, (unsigned long long)stats.lateFrames,
+        stats.framesRun ? stats.totalLatenessNanoseconds / 1e6 / stats.framesRun : 0.0, stats.worstLatenessNanoseconds / 1e6);
+
+    int status = 0;
+    if (verify) {
+        // run every session again frame by frame with the keys it recorded
+        unsigned int mismatches = 0;
+        for (unsigned int i = 0; i < sessionCount; ++i) {
+            machine.Reset(rom);
+            machine.Seed(i);
+            std::vector<Movie::InputRun> const& inputs = host.Inputs(i);
+            size_t next = 0;
+            for (uint64_t frame = 0; frame < host.Frame(i); ++frame) {
+                for (; next < inputs.size() && inputs[next].start == frame; ++next) {
+                    machine.SetKeys(inputs[next].mask);
+                }
+                machine.RunFrame(cyclesPerFrame);
+            }
+            if (machine.StateHash() != host.Machine(i).StateHash()) {
+                ++mismatches;
+            }
+        }
+        std::printf(",\n  \"verified\": %u,\n  \"mismatches\": %u", sessionCount, mismatches);
+        status = mismatches ? EXIT_FAILURE : 0;
+    }
+    std::printf("\n}\n");
+    return status;
+}
@@ -0,0 +1,152 @@
+#include "../Chip8.hpp"
+#include "../Hash.hpp"
+#include "../Netplay.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+/*
+    Headless netplay peer for testing rollback over loopback, run one per player:
+
+    chip8-netplay rom.ch8 1 7001 127.0.0.1 7002 --seed 42
+    chip8-netplay rom.ch8 2 7002 127.0.0.1 7001 --frame-us 1500 --loss 20
+
+    Each player presses scripted keys that only depend on the player and the frame, so once every
+    input is confirmed both peers, and a local run of the same script, have to end in the same state
+    however late or lost the packets were.
+*/
+
+// after both sides are done, keep answering so the peer gets our last acks
+const auto LINGER = std::chrono::milliseconds(250);
+const auto TIMEOUT = std::chrono::seconds(10);
+
+static uint16_t ScriptedKeys(unsigned int player, uint32_t frame) {
+    // a new key combination every 24 frames, player 1 on the low keys and player 2 on the high ones
+    uint16_t keys = HashMix(uint64_t(player) << 32u | frame / 24u) & 0x0F0Fu;
+    return player == 1 ? keys & 0x00FFu : keys & 0xFF00u;
+}
+
+static void PrintUsage(char const* program) {
+    std::cerr << "Usage: " << program << " <ROM> <Player 1|2> <Local port> <Remote host> <Remote port> [options]\n";
+    std::cerr << "  --frames <N>       frames to play (default 3000)\n";
+    std::cerr << "  --cycles <N>       cycles per frame (default 10)\n";
+    std::cerr << "  --rollback <N>     frames to run ahead of the peer before waiting (default 8)\n";
+    std::cerr << "  --frame-us <N>     frame length in microseconds (default 1000)\n";
+    std::cerr << "  --loss <percent>   drop this share of outgoing packets\n";
+    std::cerr << "  --seed <N>         random seed, player 1's is used (default 0)\n";
+    std::exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+    if (argc < 6){
+        PrintUsage(argv[0]);
+	}
+
+    unsigned int player = std::stoul(argv[2]);
+    uint16_t localPort = std::stoul(argv[3]);
+    uint16_t remotePort = std::stoul(argv[5]);
+    uint32_t frames = 3000;
+    unsigned int cyclesPerFrame = 10;
+    unsigned int maxRollback = 8;
+    unsigned int frameMicroseconds = 1000;
+    unsigned int loss = 0;
+    uint64_t seed = 0;
+
+    for (int i = 6; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--frames" && i + 1 < argc) {
+            frames = std::stoul(argv[++i]);
+        } else if (option == "--cycles" && i + 1 < argc) {
+            cyclesPerFrame = std::stoul(argv[++i]);
+        } else if (option == "--rollback" && i + 1 < argc) {
+            maxRollback = std::stoul(argv[++i]);
+        } else if (option == "--frame-us" && i + 1 < argc) {
+            frameMicroseconds = std::stoul(argv[++i]);
+        } else if (option == "--loss" && i + 1 < argc) {
+            loss = std::stoul(argv[++i]);
+        } else if (option == "--seed" && i + 1 < argc) {
+            seed = std::stoull(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+        }
+    }
+    if (player != 1 && player != 2) {
+        PrintUsage(argv[0]);
+    }
+
+    Chip8 chip8;
+    chip8.LoadROM(argv[1]);
+
+    Netplay netplay(chip8, player, seed, localPort, argv[4], remotePort, cyclesPerFrame, maxRollback);
+    if (!netplay.IsOpen()) {
+        std::cerr << "Could not open port " << localPort << " to " << argv[4] << ":" << remotePort << "\n";
+        return EXIT_FAILURE;
+    }
+    netplay.SimulateLoss(loss);
+
+    auto frameLength = std::chrono::microseconds(frameMicroseconds);
+    auto start = std::chrono::steady_clock::now();
+    auto deadline = start + TIMEOUT;
+    auto next = start;
+
+    while (!netplay.Handshake()) {
+        if (netplay.Mismatched() || std::chrono::steady_clock::now() > deadline) {
+            std::cerr << (netplay.Mismatched() ? "Peer runs another ROM, frame length or the same player\n" : "No answer from the peer\n");
+            return EXIT_FAILURE;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // the slowest frame shows what a rollback costs on top of a normal one
+    float worstFrameMs = 0;
+    deadline = std::chrono::steady_clock::now() + TIMEOUT;
+
+    while (netplay.Frame() < frames) {
+        next += frameLength;
+        std::this_thread::sleep_until(next);
+
+        auto frameStart = std::chrono::steady_clock::now();
+        if (frameStart > deadline) {
+            std::cerr << "Timed out at frame " << netplay.Frame() << "\n";
+            return EXIT_FAILURE;
+        }
+        if (netplay.AdvanceFrame(ScriptedKeys(player, netplay.Frame()))) {
+            deadline = frameStart + TIMEOUT;
+        }
+        float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::steady_clock::now() - frameStart).count();
+        worstFrameMs = ms > worstFrameMs ? ms : worstFrameMs;
+    }
+
+    // wait for the last remote inputs and for the peer to have all of ours
+    while (netplay.ConfirmedFrame() < frames || netplay.AckedFrame() < frames) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            std::cerr << "Timed out waiting for the peer to confirm the last frames\n";
+            return EXIT_FAILURE;
+        }
+        netplay.Poll();
+        std::this_thread::sleep_for(frameLength);
+    }
+    uint64_t hash = chip8.StateHash();
+
+    for (auto linger = std::chrono::steady_clock::now() + LINGER; std::chrono::steady_clock::now() < linger;) {
+        netplay.Poll();
+        std::this_thread::sleep_for(frameLength);
+    }
+
+    // the same script played locally, without any prediction
+    Chip8 local;
+    local.LoadROM(argv[1]);
+    local.Seed(netplay.Seed());
+    for (uint32_t frame = 0; frame < frames; ++frame) {
+        local.SetKeys(ScriptedKeys(1, frame) | ScriptedKeys(2, frame));
+        local.RunFrame(cyclesPerFrame);
+    }
+    bool ok = local.StateHash() == hash;
+
+    std::cout << (ok ? "ok" : "MISMATCH") << ": player " << player << ", " << frames << " frames, "
+        << netplay.Rollbacks() << " rollbacks, " << netplay.ResimulatedFrames() << " frames resimulated, "
+        << netplay.Stalls() << " stalls, slowest frame " << worstFrameMs << " ms, state "
+        << std::hex << hash << "\n";
+    return ok ? 0 : EXIT_FAILURE;
+}
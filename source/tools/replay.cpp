@@ -0,0 +1,115 @@
+#include "../Chip8.hpp"
+#include "../Movie.hpp"
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Prints the screen the way a movie viewer would show it at the seeked frame.
+static void PrintScreen(Chip8 const& chip8) {
+    for (unsigned int y = 0; y < VIDEO_HEIGHT; ++y) {
+        std::string line;
+        for (unsigned int x = 0; x < VIDEO_WIDTH; ++x) {
+            line += chip8.Pixel(x, y) ? '#' : '.';
+        }
+        std::cout << line << "\n";
+    }
+}
+
+static void PrintUsage(char const* program) {
+    std::cerr << "Usage: " << program << " <ROM> <Movie> [options]\n";
+    std::cerr << "  --seek <frame>     jump to a frame through the keyframes and print the screen\n";
+    std::cerr << "  --threads <N>      verify keyframe segments in parallel (default: all cores)\n";
+    std::cerr << "  --serial           replay from frame 0 on a single thread\n";
+    std::cerr << "  --rerecord <file>  record the movie's inputs again with this build's hashes and keyframes\n";
+    std::cerr << "  --hash-interval <N>, --keyframe-interval <N>\n";
+    std::cerr << "                     spacing of the re-recorded hashes (default 1) and keyframes (default 3600)\n";
+    std::exit(EXIT_FAILURE);
+}
+
+// Replays an input movie headless at full speed and checks every recorded state hash,
+// or with --seek jumps straight to one frame through the movie's keyframes.
+int main(int argc, char** argv) {
+    if (argc < 3){
+        PrintUsage(argv[0]);
+	}
+
+    bool seek = false;
+    uint32_t seekFrame = 0;
+    bool serial = false;
+    char const* rerecordPath = nullptr;
+    unsigned int hashInterval = 1;
+    unsigned int keyframeInterval = 3600;
+    unsigned int threads = std::thread::hardware_concurrency();
+
+    for (int i = 3; i < argc; ++i) {
+        std::string option = argv[i];
+        if (option == "--seek" && i + 1 < argc) {
+            seek = true;
+            seekFrame = std::stoul(argv[++i]);
+        } else if (option == "--threads" && i + 1 < argc) {
+            threads = std::stoul(argv[++i]);
+        } else if (option == "--serial") {
+            serial = true;
+        } else if (option == "--rerecord" && i + 1 < argc) {
+            rerecordPath = argv[++i];
+        } else if (option == "--hash-interval" && i + 1 < argc) {
+            hashInterval = std::stoul(argv[++i]);
+        } else if (option == "--keyframe-interval" && i + 1 < argc) {
+            keyframeInterval = std::stoul(argv[++i]);
+        } else {
+            PrintUsage(argv[0]);
+        }
+    }
+
+    Movie movie;
+    if (!movie.Load(argv[2])) {
+        std::cerr << "Could not read movie " << argv[2] << "\n";
+        std::exit(EXIT_FAILURE);
+    }
+
+    Chip8 chip8;
+    chip8.LoadROM(argv[1]);
+
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (seek) {
+        uint32_t frame = seekFrame;
+        if (!SeekMovie(movie, chip8, frame)) {
+            std::cerr << "Could not seek to frame " << frame << " (movie has " << movie.frameCount << " frames, "
+                << movie.keyframes.size() << " keyframes)\n";
+            return EXIT_FAILURE;
+        }
+        float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+        PrintScreen(chip8);
+        std::cout << "frame " << frame << " reached in " << ms << " ms, state " << std::hex << chip8.StateHash() << "\n";
+        return 0;
+    }
+
+    if (rerecordPath) {
+        if (!RerecordMovie(movie, chip8, rerecordPath, hashInterval, keyframeInterval)) {
+            std::cerr << "Could not re-record to " << rerecordPath << "\n";
+            return EXIT_FAILURE;
+        }
+        std::cout << "re-recorded " << movie.frameCount << " frames to " << rerecordPath << "\n";
+        return 0;
+    }
+
+    PlaybackResult result = serial ? PlayMovie(movie, chip8) : VerifyMovie(movie, chip8, threads ? threads : 1);
+    float ms = std::chrono::duration<float, std::chrono::milliseconds::period>(std::chrono::high_resolution_clock::now() - start).count();
+
+    if (!result.ok) {
+        if (result.romMismatch) {
+            std::cout << "ROM mismatch: movie was recorded with ROM " << std::hex << result.expected << ", got " << result.actual << "\n";
+        } else {
+            std::cout << "DIVERGED at frame " << result.divergedFrame
+                << ": expected state " << std::hex << result.expected << ", got " << result.actual << "\n";
+        }
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "ok: " << result.frames << " frames, " << result.checks << " checks passed in " << ms << " ms ("
+        << (ms > 0 ? result.frames / ms * 1000.0f : 0.0f) << " frames/s)\n";
+    return 0;
+}